@@ -0,0 +1,64 @@
+/***
+ *  MIT License
+ *
+ *  Copyright (c) 2021 SlickTech <support@slicktech.org>
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ */
+
+#include "benchmarks.h"
+#include <libwebsockets.h>
+#include <string>
+#include <unordered_set>
+
+using namespace slick::net::bench;
+
+/**
+ * Usage: slicksocket_bench [benchmark...]
+ * Runs all benchmarks when none specified.
+ */
+int main(int argc, char* argv[]) {
+  lws_set_log_level(LLL_ERR, nullptr);
+
+  std::unordered_set<std::string> selected(argv + 1, argv + argc);
+  auto enabled = [&selected](const char* name) { return selected.empty() || selected.count(name); };
+
+  if (enabled("http_burst")) {
+    http_burst_bench();
+  }
+  if (enabled("http")) {
+    http_bench();
+  }
+  if (enabled("websocket")) {
+    websocket_bench();
+  }
+  if (enabled("socket")) {
+    socket_bench();
+  }
+  if (enabled("send")) {
+    send_bench();
+  }
+  if (enabled("ring")) {
+    ring_bench();
+  }
+  if (enabled("compression")) {
+    compression_bench();
+  }
+  return 0;
+}
@@ -0,0 +1,392 @@
+/***
+ *  MIT License
+ *
+ *  Copyright (c) 2021 SlickTech <support@slicktech.org>
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ */
+
+#pragma once
+
+#include <libwebsockets.h>
+#include <slicksocket/callback.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace slick {
+namespace net {
+namespace bench {
+
+inline uint64_t now_ns() noexcept {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/**
+ * Collects latency samples and reports percentiles
+ */
+class latency_stats {
+  std::vector<uint64_t> samples_;
+  bool sorted_ = true;
+
+ public:
+  void reserve(size_t n) { samples_.reserve(n); }
+
+  void add(uint64_t ns) {
+    samples_.push_back(ns);
+    sorted_ = false;
+  }
+
+  size_t count() const noexcept { return samples_.size(); }
+
+  void merge(const latency_stats& other) {
+    samples_.insert(samples_.end(), other.samples_.begin(), other.samples_.end());
+    sorted_ = false;
+  }
+
+  uint64_t percentile(double p) {
+    if (samples_.empty()) {
+      return 0;
+    }
+    if (!sorted_) {
+      std::sort(samples_.begin(), samples_.end());
+      sorted_ = true;
+    }
+    auto index = static_cast<size_t>(p / 100.0 * (samples_.size() - 1) + 0.5);
+    return samples_[std::min(index, samples_.size() - 1)];
+  }
+
+  void print(const char* name) {
+    printf("%-48s n=%-8zu min=%9.2fus p50=%9.2fus p99=%9.2fus p99.9=%9.2fus max=%9.2fus\n",
+           name,
+           count(),
+           percentile(0) / 1000.0,
+           percentile(50) / 1000.0,
+           percentile(99) / 1000.0,
+           percentile(99.9) / 1000.0,
+           percentile(100) / 1000.0);
+  }
+};
+
+inline void print_throughput(const char* name, uint64_t msgs, uint64_t bytes, uint64_t ns) {
+  auto secs = ns / 1e9;
+  printf("%-48s n=%-8llu %12.0f msgs/s %10.2f MB/s\n",
+         name,
+         (unsigned long long)msgs,
+         msgs / secs,
+         bytes / secs / (1024 * 1024));
+}
+
+inline void wait_until(const std::function<bool()>& pred) {
+  while (!pred()) {
+    std::this_thread::yield();
+  }
+}
+
+/**
+ * Drives a client against an echo server.
+ * rtt mode sends one message at a time and records its round trip,
+ * throughput mode keeps a window of messages in flight.
+ * Replies are counted in bytes since raw sockets don't preserve message boundaries.
+ */
+class echo_driver : public client_callback_t {
+  std::function<bool(const char*, size_t)> send_;
+  std::mutex send_mutex_;
+  std::string message_;
+  latency_stats rtt_;
+  uint64_t sent_at_ = 0;
+  size_t received_ = 0;
+  size_t sent_ = 0;
+  size_t count_ = 0;
+  std::atomic_size_t completed_{0};
+  std::atomic_bool connected_{false};
+  std::atomic_bool done_{true};
+  bool measure_rtt_ = false;
+
+ public:
+  void set_sender(std::function<bool(const char*, size_t)> send) { send_ = std::move(send); }
+
+  bool connected() const noexcept { return connected_.load(std::memory_order_acquire); }
+  bool done() const noexcept { return done_.load(std::memory_order_acquire); }
+  latency_stats& rtt() noexcept { return rtt_; }
+
+  void start_rtt(size_t msg_size, size_t iterations) {
+    start(msg_size, iterations, true);
+    sent_at_ = now_ns();
+    send_one();
+  }
+
+  void start_throughput(size_t msg_size, size_t count, size_t window) {
+    start(msg_size, count, false);
+    for (size_t i = 0; i < std::min(window, count); ++i) {
+      send_one();
+    }
+  }
+
+  void on_connected() override { connected_.store(true, std::memory_order_release); }
+  void on_disconnected() override { connected_.store(false, std::memory_order_release); }
+  void on_error(const char* msg, size_t len) override {
+    printf("echo_driver error: %.*s\n", (int)len, msg ? msg : "");
+  }
+
+  void on_data(const char* data, size_t len, size_t remaining) override {
+    received_ += len;
+    while (received_ >= message_.size() && !done()) {
+      received_ -= message_.size();
+      auto completed = completed_.fetch_add(1, std::memory_order_relaxed) + 1;
+      if (measure_rtt_) {
+        auto now = now_ns();
+        rtt_.add(now - sent_at_);
+        sent_at_ = now;
+      }
+      if (completed == count_) {
+        done_.store(true, std::memory_order_release);
+      } else {
+        send_one();
+      }
+    }
+  }
+
+ private:
+  void start(size_t msg_size, size_t count, bool measure_rtt) {
+    message_.assign(msg_size, 'x');
+    rtt_ = latency_stats();
+    rtt_.reserve(measure_rtt ? count : 0);
+    received_ = 0;
+    sent_ = 0;
+    count_ = count;
+    measure_rtt_ = measure_rtt;
+    completed_.store(0, std::memory_order_relaxed);
+    done_.store(false, std::memory_order_release);
+  }
+
+  void send_one() {
+    // first messages are sent from the bench thread, the rest from the service thread
+    std::lock_guard<std::mutex> g(send_mutex_);
+    if (sent_ == count_) {
+      return;
+    }
+    while (!send_(message_.data(), message_.size())) {
+      std::this_thread::yield();
+    }
+    ++sent_;
+  }
+};
+
+/**
+ * Minimal lws based WebSocket echo server
+ */
+class local_ws_echo_server {
+  lws_context* context_ = nullptr;
+  std::thread thread_;
+  std::atomic_bool run_{true};
+  std::unordered_map<lws*, std::string> partial_;
+  std::unordered_map<lws*, std::deque<std::string>> pending_;
+
+ public:
+  explicit local_ws_echo_server(int32_t port) {
+    // websocket_client asks for the "ws" protocol
+    static const struct lws_protocols protocols[] = {
+        {"ws", local_ws_echo_server::callback, 0, 0},
+        {nullptr, nullptr, 0, 0}
+    };
+
+    lws_context_creation_info context_info;
+    memset(&context_info, 0, sizeof(context_info));
+    context_info.port = port;
+    context_info.protocols = protocols;
+    context_info.user = this;
+
+    context_ = lws_create_context(&context_info);
+    if (!context_) {
+      lwsl_err("local_ws_echo_server failed to listen on %d\n", port);
+      return;
+    }
+
+    thread_ = std::thread([this]() {
+      while (run_.load(std::memory_order_relaxed)) {
+        lws_service(context_, 0);
+      }
+    });
+  }
+
+  ~local_ws_echo_server() {
+    run_.store(false, std::memory_order_relaxed);
+    if (context_) {
+      lws_cancel_service(context_);
+    }
+    if (thread_.joinable()) {
+      thread_.join();
+    }
+    if (context_) {
+      lws_context_destroy(context_);
+      context_ = nullptr;
+    }
+  }
+
+  bool ready() const noexcept { return context_ != nullptr; }
+
+ private:
+  static int callback(struct lws *wsi, enum lws_callback_reasons reason, void *user, void *in, size_t len) {
+    auto server = reinterpret_cast<local_ws_echo_server*>(lws_context_user(lws_get_context(wsi)));
+    switch (reason) {
+      case LWS_CALLBACK_RECEIVE: {
+        auto& partial = server->partial_[wsi];
+        if (partial.empty()) {
+          partial.assign(LWS_PRE, '\0');
+        }
+        partial.append((const char*)in, len);
+        if (lws_is_final_fragment(wsi) && !lws_remaining_packet_payload(wsi)) {
+          server->pending_[wsi].emplace_back(std::move(partial));
+          partial.clear();
+          lws_callback_on_writable(wsi);
+        }
+        break;
+      }
+
+      case LWS_CALLBACK_SERVER_WRITEABLE: {
+        auto& pending = server->pending_[wsi];
+        if (pending.empty()) {
+          break;
+        }
+        auto& msg = pending.front();
+        auto n = msg.size() - LWS_PRE;
+        if (lws_write(wsi, (unsigned char*)&msg[LWS_PRE], n, LWS_WRITE_TEXT) < (int)n) {
+          return -1;
+        }
+        pending.pop_front();
+        if (!pending.empty()) {
+          lws_callback_on_writable(wsi);
+        }
+        break;
+      }
+
+      case LWS_CALLBACK_CLOSED:
+        server->partial_.erase(wsi);
+        server->pending_.erase(wsi);
+        break;
+
+      default:
+        break;
+    }
+    return lws_callback_http_dummy(wsi, reason, user, in, len);
+  }
+};
+
+/**
+ * Minimal lws based HTTP server replying a fixed body to every request
+ */
+class local_http_server {
+  lws_context* context_ = nullptr;
+  std::thread thread_;
+  std::atomic_bool run_{true};
+  std::vector<unsigned char> body_;
+
+ public:
+  local_http_server(int32_t port, const std::string& body)
+    : body_(LWS_PRE + body.size()) {
+    memcpy(&body_[LWS_PRE], body.data(), body.size());
+
+    static const struct lws_protocols protocols[] = {
+        {"http", local_http_server::callback, 0, 0},
+        {nullptr, nullptr, 0, 0}
+    };
+
+    lws_context_creation_info context_info;
+    memset(&context_info, 0, sizeof(context_info));
+    context_info.port = port;
+    context_info.protocols = protocols;
+    context_info.user = this;
+
+    context_ = lws_create_context(&context_info);
+    if (!context_) {
+      lwsl_err("local_http_server failed to listen on %d\n", port);
+      return;
+    }
+
+    thread_ = std::thread([this]() {
+      while (run_.load(std::memory_order_relaxed)) {
+        lws_service(context_, 0);
+      }
+    });
+  }
+
+  ~local_http_server() {
+    run_.store(false, std::memory_order_relaxed);
+    if (context_) {
+      lws_cancel_service(context_);
+    }
+    if (thread_.joinable()) {
+      thread_.join();
+    }
+    if (context_) {
+      lws_context_destroy(context_);
+      context_ = nullptr;
+    }
+  }
+
+  bool ready() const noexcept { return context_ != nullptr; }
+
+ private:
+  static int callback(struct lws *wsi, enum lws_callback_reasons reason, void *user, void *in, size_t len) {
+    auto server = reinterpret_cast<local_http_server*>(lws_context_user(lws_get_context(wsi)));
+    switch (reason) {
+      case LWS_CALLBACK_HTTP: {
+        unsigned char buf[LWS_PRE + 256];
+        unsigned char *start = &buf[LWS_PRE], *p = start, *end = &buf[sizeof(buf) - 1];
+        auto body_len = server->body_.size() - LWS_PRE;
+        if (lws_add_http_common_headers(wsi, HTTP_STATUS_OK, "application/json", body_len, &p, end)
+            || lws_finalize_write_http_header(wsi, start, &p, end)) {
+          return 1;
+        }
+        lws_callback_on_writable(wsi);
+        return 0;
+      }
+
+      case LWS_CALLBACK_HTTP_WRITEABLE: {
+        auto body_len = server->body_.size() - LWS_PRE;
+        if (lws_write(wsi, &server->body_[LWS_PRE], body_len, LWS_WRITE_HTTP_FINAL) != (int)body_len) {
+          return 1;
+        }
+        if (lws_http_transaction_completed(wsi)) {
+          return -1;
+        }
+        return 0;
+      }
+
+      default:
+        break;
+    }
+    return lws_callback_http_dummy(wsi, reason, user, in, len);
+  }
+};
+
+}
+}
+}
@@ -0,0 +1,75 @@
+/***
+ *  MIT License
+ *
+ *  Copyright (c) 2021 SlickTech <support@slicktech.org>
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ */
+
+#pragma once
+
+namespace slick {
+namespace net {
+namespace bench {
+
+/**
+ * Time to response for a burst of asynchronous http_client requests,
+ * draining one request per service loop iteration versus the whole queue.
+ */
+void http_burst_bench();
+
+/**
+ * Sync request round trip and async request throughput of http_client
+ * across response sizes, with and without keep-alive.
+ */
+void http_bench();
+
+/**
+ * Round trip and throughput of websocket_client against a local echo server
+ * across message sizes and connection counts.
+ */
+void websocket_bench();
+
+/**
+ * Round trip and throughput of socket_client against a socket_server echo server
+ * across message sizes and connection counts.
+ */
+void socket_bench();
+
+/**
+ * Concurrent producers sending into one send buffer, lock free
+ * versus serialized by an external mutex.
+ */
+void send_bench();
+
+/**
+ * Cross core throughput of ring_buffer, ring_string_buffer and object_pool,
+ * sensitive to false sharing between producer and consumer state.
+ */
+void ring_bench();
+
+/**
+ * Bandwidth versus CPU cost of permessage-deflate on a replayed market data feed,
+ * pushed by a local server to websocket_client.
+ */
+void compression_bench();
+
+}
+}
+}
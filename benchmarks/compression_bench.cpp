@@ -0,0 +1,301 @@
+/***
+ *  MIT License
+ *
+ *  Copyright (c) 2021 SlickTech <support@slicktech.org>
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ */
+
+
+#include "benchmarks.h"
+#include "bench_utils.h"
+#include <slicksocket/websocket_client.h>
+#include <ctime>
+#include <fstream>
+#include <random>
+
+#if defined(__linux__)
+#include <netinet/in.h>
+#include <linux/tcp.h>
+#include <sys/socket.h>
+#endif
+
+using namespace slick::net;
+using namespace slick::net::bench;
+
+namespace {
+
+constexpr int32_t kPort = 18083;
+constexpr size_t kMessages = 20000;
+
+/**
+ * Feed to replay. One message per line from the file named by SLICK_BENCH_FEED,
+ * otherwise synthetic JSON order book updates shaped like a venue depth feed.
+ */
+std::vector<std::string> load_feed() {
+  std::vector<std::string> feed;
+  auto path = getenv("SLICK_BENCH_FEED");
+  if (path) {
+    std::ifstream in(path);
+    std::string line;
+    while (std::getline(in, line) && feed.size() < kMessages) {
+      if (!line.empty()) {
+        feed.emplace_back(std::move(line));
+      }
+    }
+    if (feed.empty()) {
+      printf("compression: no messages in %s, using synthetic feed\n", path);
+    }
+  }
+
+  if (feed.empty()) {
+    std::mt19937 rng(42);
+    std::uniform_int_distribution<int> tick(-20, 20);
+    std::uniform_int_distribution<int> qty(1, 50000);
+    std::uniform_int_distribution<int> levels(1, 25);
+    char level[64];
+    uint64_t seq = 1000000;
+    for (size_t i = 0; i < kMessages; ++i) {
+      std::string msg = "{\"type\":\"l2update\",\"product_id\":\"BTC-USD\",\"sequence\":" + std::to_string(++seq) + ",\"changes\":[";
+      auto n = levels(rng);
+      for (int l = 0; l < n; ++l) {
+        snprintf(level, sizeof(level), "%s[\"%s\",\"%d.%02d\",\"%d.%04d\"]",
+                 l ? "," : "", (l & 1) ? "sell" : "buy", 43000 + tick(rng), l, qty(rng) / 10000, qty(rng) % 10000);
+        msg += level;
+      }
+      msg += "],\"time\":\"2021-06-01T12:00:00.000000Z\"}";
+      feed.emplace_back(std::move(msg));
+    }
+  }
+  return feed;
+}
+
+/**
+ * lws server pushing the feed to every client that connects, accepting permessage-deflate if offered
+ */
+class replay_server {
+  lws_context* context_ = nullptr;
+  std::thread thread_;
+  std::atomic_bool run_{true};
+  std::vector<std::string> feed_;
+  std::unordered_map<lws*, size_t> next_;
+  std::atomic<uint64_t> wire_bytes_{0};
+
+ public:
+  replay_server(int32_t port, const std::vector<std::string>& feed) {
+    for (auto& msg : feed) {
+      feed_.emplace_back(std::string(LWS_PRE, '\0') + msg);
+    }
+
+    static const struct lws_protocols protocols[] = {
+        {"ws", replay_server::callback, 0, 0},
+        {nullptr, nullptr, 0, 0}
+    };
+    static const struct lws_extension extensions[] = {
+        {"permessage-deflate", lws_extension_callback_pm_deflate, "permessage-deflate"},
+        {nullptr, nullptr, nullptr}
+    };
+
+    lws_context_creation_info context_info;
+    memset(&context_info, 0, sizeof(context_info));
+    context_info.port = port;
+    context_info.protocols = protocols;
+    context_info.extensions = extensions;
+    context_info.user = this;
+
+    context_ = lws_create_context(&context_info);
+    if (!context_) {
+      lwsl_err("replay_server failed to listen on %d\n", port);
+      return;
+    }
+
+    thread_ = std::thread([this]() {
+      while (run_.load(std::memory_order_relaxed)) {
+        lws_service(context_, 0);
+      }
+    });
+  }
+
+  ~replay_server() {
+    run_.store(false, std::memory_order_relaxed);
+    if (context_) {
+      lws_cancel_service(context_);
+    }
+    if (thread_.joinable()) {
+      thread_.join();
+    }
+    if (context_) {
+      lws_context_destroy(context_);
+      context_ = nullptr;
+    }
+  }
+
+  bool ready() const noexcept { return context_ != nullptr; }
+
+  /**
+   * Bytes the kernel sent for the last finished replay, framing and compression included. 0 if unknown.
+   */
+  uint64_t wire_bytes() const noexcept { return wire_bytes_.load(std::memory_order_acquire); }
+
+ private:
+  static uint64_t bytes_sent(lws* wsi) {
+#if defined(__linux__) && defined(TCP_INFO)
+    tcp_info info;
+    socklen_t len = sizeof(info);
+    if (getsockopt(lws_get_socket_fd(wsi), IPPROTO_TCP, TCP_INFO, &info, &len) == 0) {
+      return info.tcpi_bytes_acked;
+    }
+#endif
+    return 0;
+  }
+
+  static int callback(struct lws *wsi, enum lws_callback_reasons reason, void *user, void *in, size_t len) {
+    auto server = reinterpret_cast<replay_server*>(lws_context_user(lws_get_context(wsi)));
+    switch (reason) {
+      case LWS_CALLBACK_ESTABLISHED:
+        server->next_[wsi] = 0;
+        lws_callback_on_writable(wsi);
+        break;
+
+      case LWS_CALLBACK_SERVER_WRITEABLE: {
+        auto& next = server->next_[wsi];
+        if (next == server->feed_.size()) {
+          break;
+        }
+        auto& msg = server->feed_[next];
+        auto n = msg.size() - LWS_PRE;
+        if (lws_write(wsi, (unsigned char*)&msg[LWS_PRE], n, LWS_WRITE_TEXT) < (int)n) {
+          return -1;
+        }
+        if (++next < server->feed_.size()) {
+          lws_callback_on_writable(wsi);
+        }
+        break;
+      }
+
+      case LWS_CALLBACK_CLOSED:
+        // the client only closes once it received the whole feed, so everything was acked
+        server->wire_bytes_.store(bytes_sent(wsi), std::memory_order_release);
+        server->next_.erase(wsi);
+        break;
+
+      default:
+        break;
+    }
+    return lws_callback_http_dummy(wsi, reason, user, in, len);
+  }
+};
+
+/**
+ * Counts received payload bytes until the whole feed arrived
+ */
+class feed_receiver : public client_callback_t {
+  size_t expected_;
+  size_t received_ = 0;
+  std::atomic_bool connected_{false};
+  std::atomic_bool done_{false};
+
+ public:
+  explicit feed_receiver(size_t expected) : expected_(expected) {}
+
+  bool connected() const noexcept { return connected_.load(std::memory_order_acquire); }
+  bool done() const noexcept { return done_.load(std::memory_order_acquire); }
+
+  void on_connected() override { connected_.store(true, std::memory_order_release); }
+  void on_disconnected() override { connected_.store(false, std::memory_order_release); }
+  void on_error(const char* msg, size_t len) override {
+    printf("feed_receiver error: %.*s\n", (int)len, msg ? msg : "");
+    done_.store(true, std::memory_order_release);
+  }
+
+  void on_data(const char* data, size_t len, size_t remaining) override {
+    received_ += len;
+    if (received_ >= expected_) {
+      done_.store(true, std::memory_order_release);
+    }
+  }
+};
+
+void run(const char* name, replay_server& server, size_t payload_bytes, const ws_compression_options& compression) {
+  service_options options;
+  options.strategy = wait_strategy::busy_spin;
+  options.ws_compression = compression;
+
+  feed_receiver receiver(payload_bytes);
+  {
+    websocket_client client(&receiver, "ws://127.0.0.1:" + std::to_string(kPort) + "/", "", "", -1, false, options);
+    auto cpu_start = std::clock();
+    auto start = now_ns();
+    client.connect();
+    wait_until([&receiver]() { return receiver.done(); });
+    auto elapsed = now_ns() - start;
+    auto cpu = std::clock() - cpu_start;
+    client.stop();
+    // wait for the server to see the close and sample the socket
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+
+    auto wire = server.wire_bytes();
+    auto secs = elapsed / 1e9;
+    // both ends run in this process, cpu covers compression and decompression
+    printf("%-48s payload=%8.2fMB wire=%8.2fMB ratio=%6.2f %10.2f MB/s cpu=%8.2fms (%6.2fus/msg)\n",
+           name,
+           payload_bytes / (1024.0 * 1024),
+           wire / (1024.0 * 1024),
+           wire ? (double)payload_bytes / wire : 0.0,
+           payload_bytes / secs / (1024 * 1024),
+           cpu * 1000.0 / CLOCKS_PER_SEC,
+           cpu * 1e6 / CLOCKS_PER_SEC / kMessages);
+  }
+}
+
+}
+
+namespace slick {
+namespace net {
+namespace bench {
+
+void compression_bench() {
+  auto feed = load_feed();
+  size_t payload_bytes = 0;
+  for (auto& msg : feed) {
+    payload_bytes += msg.size();
+  }
+
+  replay_server server(kPort, feed);
+  if (!server.ready()) {
+    return;
+  }
+
+  ws_compression_options compression;
+  run("compression off", server, payload_bytes, compression);
+
+  compression.enabled = true;
+  run("compression deflate window=15", server, payload_bytes, compression);
+
+  compression.server_max_window_bits = 10;
+  run("compression deflate window=10", server, payload_bytes, compression);
+
+  compression.server_max_window_bits = 15;
+  compression.server_no_context_takeover = true;
+  run("compression deflate window=15 no_context_takeover", server, payload_bytes, compression);
+}
+
+}
+}
+}
@@ -0,0 +1,120 @@
+/***
+ *  MIT License
+ *
+ *  Copyright (c) 2021 SlickTech <support@slicktech.org>
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ */
+
+#include "benchmarks.h"
+#include "bench_utils.h"
+#include <slicksocket/http_client.h>
+
+using namespace slick::net;
+using namespace slick::net::bench;
+
+namespace {
+
+constexpr int32_t kPort = 18083;
+constexpr size_t kSyncIterations = 2000;
+constexpr size_t kAsyncRequests = 5000;
+
+void run_sync(int32_t port, size_t body_size, bool keep_alive) {
+  service_options options;
+  options.http_keep_alive = keep_alive;
+  http_client client("http://127.0.0.1:" + std::to_string(port), "", "", -1, false, options);
+
+  latency_stats rtt;
+  rtt.reserve(kSyncIterations);
+  for (size_t i = 0; i < kSyncIterations; ++i) {
+    auto start = now_ns();
+    auto response = client.request("GET", "/");
+    rtt.add(now_ns() - start);
+    if (response.status != 200) {
+      printf("http sync request failed. status=%d\n", response.status);
+      return;
+    }
+  }
+
+  char name[64];
+  snprintf(name, sizeof(name), "http sync rtt size=%zu keep_alive=%d", body_size, keep_alive);
+  rtt.print(name);
+}
+
+void run_async(int32_t port, size_t body_size, bool keep_alive, size_t concurrency) {
+  service_options options;
+  options.http_keep_alive = keep_alive;
+  http_client client("http://127.0.0.1:" + std::to_string(port), "", "", -1, false, options);
+
+  std::atomic_size_t issued{0};
+  std::atomic_size_t completed{0};
+  std::atomic_size_t bytes{0};
+  std::function<void()> issue;
+  issue = [&]() {
+    if (issued.fetch_add(1, std::memory_order_relaxed) >= kAsyncRequests) {
+      return;
+    }
+    client.request("GET", "/", [&](http_response rsp) {
+      bytes.fetch_add(rsp.response_text.size(), std::memory_order_relaxed);
+      // keep concurrency requests in flight. Issue before completing so the
+      // bench can't return while this callback still uses its locals.
+      issue();
+      completed.fetch_add(1, std::memory_order_release);
+    });
+  };
+
+  auto start = now_ns();
+  for (size_t i = 0; i < concurrency; ++i) {
+    issue();
+  }
+  wait_until([&completed]() { return completed.load(std::memory_order_acquire) == kAsyncRequests; });
+  auto elapsed = now_ns() - start;
+
+  char name[64];
+  snprintf(name, sizeof(name), "http async size=%zu keep_alive=%d inflight=%zu", body_size, keep_alive, concurrency);
+  print_throughput(name, kAsyncRequests, bytes.load(std::memory_order_relaxed), elapsed);
+}
+
+}
+
+namespace slick {
+namespace net {
+namespace bench {
+
+void http_bench() {
+  int32_t port = kPort;
+  for (size_t body_size : {64, 4096, 65536}) {
+    local_http_server server(port, std::string(body_size, 'x'));
+    if (!server.ready()) {
+      return;
+    }
+
+    for (bool keep_alive : {false, true}) {
+      run_sync(port, body_size, keep_alive);
+      for (size_t concurrency : {1, 16}) {
+        run_async(port, body_size, keep_alive, concurrency);
+      }
+    }
+    ++port;
+  }
+}
+
+}
+}
+}
@@ -0,0 +1,104 @@
+/***
+ *  MIT License
+ *
+ *  Copyright (c) 2021 SlickTech <support@slicktech.org>
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ */
+
+#include "benchmarks.h"
+#include "bench_utils.h"
+#include <slicksocket/http_client.h>
+
+using namespace slick::net;
+using namespace slick::net::bench;
+
+namespace {
+
+constexpr int32_t kPort = 18080;
+constexpr size_t kRounds = 20;
+
+void run_burst(size_t burst, uint32_t max_requests_per_poll) {
+  service_options options;
+  options.max_requests_per_poll = max_requests_per_poll;
+  http_client client("http://127.0.0.1:" + std::to_string(kPort), "", "", -1, false, options);
+
+  // warm up
+  client.request("GET", "/");
+
+  latency_stats first;
+  latency_stats each;
+  latency_stats last;
+  std::vector<uint64_t> arrivals(burst);
+  each.reserve(burst * kRounds);
+
+  for (size_t round = 0; round < kRounds; ++round) {
+    std::atomic_size_t completed{0};
+    auto start = now_ns();
+    for (size_t i = 0; i < burst; ++i) {
+      client.request("GET", "/", [&arrivals, &completed, start, i](http_response rsp) {
+        arrivals[i] = now_ns() - start;
+        completed.fetch_add(1, std::memory_order_release);
+      });
+    }
+
+    while (completed.load(std::memory_order_acquire) != burst) {
+      std::this_thread::yield();
+    }
+
+    for (auto ns : arrivals) {
+      each.add(ns);
+    }
+    first.add(*std::min_element(arrivals.begin(), arrivals.end()));
+    last.add(*std::max_element(arrivals.begin(), arrivals.end()));
+  }
+
+  char name[64];
+  const char* mode = max_requests_per_poll ? "one per poll (cap 1)" : "drain all";
+  snprintf(name, sizeof(name), "http_burst n=%zu %s first", burst, mode);
+  first.print(name);
+  snprintf(name, sizeof(name), "http_burst n=%zu %s each", burst, mode);
+  each.print(name);
+  snprintf(name, sizeof(name), "http_burst n=%zu %s last", burst, mode);
+  last.print(name);
+}
+
+}
+
+namespace slick {
+namespace net {
+namespace bench {
+
+void http_burst_bench() {
+  local_http_server server(kPort, "{\"result\":\"ok\"}");
+  if (!server.ready()) {
+    return;
+  }
+
+  for (size_t burst : {1, 20, 100, 500}) {
+    // a cap of 1 starts one request per lws_service call under any wait strategy,
+    // which is how the service loop behaved before batch draining
+    run_burst(burst, 1);
+    run_burst(burst, 0);
+  }
+}
+
+}
+}
+}
@@ -0,0 +1,146 @@
+/***
+ *  MIT License
+ *
+ *  Copyright (c) 2021 SlickTech <support@slicktech.org>
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ */
+
+#include "benchmarks.h"
+#include "bench_utils.h"
+#include "ring_buffer.h"
+#include "utils.h"
+#include <memory>
+
+using namespace slick::net;
+using namespace slick::net::bench;
+
+namespace {
+
+constexpr size_t kItems = 10000000;
+constexpr size_t kMessages = 5000000;
+constexpr size_t kPoolOps = 2000000;
+
+// producer and consumer on different cores so shared cache lines have to move between them
+constexpr int32_t kProducerCpu = 0;
+constexpr int32_t kConsumerCpu = 1;
+
+void ring_buffer_throughput() {
+  std::unique_ptr<ring_buffer<uint64_t>> ring(new ring_buffer<uint64_t>(65536));
+  std::thread consumer([&ring]() {
+    set_cpu_affinity(kConsumerCpu);
+    uint64_t cursor = 0;
+    uint64_t sum = 0;
+    while (cursor < kItems) {
+      auto available = ring->available();
+      if (cursor == available) {
+        std::this_thread::yield();
+      }
+      while (cursor < available) {
+        sum += (*ring)[cursor++];
+      }
+    }
+    (void)sum;
+  });
+
+  set_cpu_affinity(kProducerCpu);
+  auto start = now_ns();
+  for (size_t i = 0; i < kItems; ++i) {
+    // don't lap the consumer
+    wait_until([&ring, i]() { return i - ring->available() < ring->capacity(); });
+    auto slot = ring->reserve();
+    slot[0] = i;
+    slot.publish();
+  }
+  consumer.join();
+  print_throughput("ring ring_buffer<uint64_t> spsc", kItems, kItems * sizeof(uint64_t), now_ns() - start);
+}
+
+void ring_string_buffer_throughput(size_t msg_size) {
+  std::unique_ptr<ring_string_buffer> ring(new ring_string_buffer(1 << 16));
+  std::thread consumer([&ring]() {
+    set_cpu_affinity(kConsumerCpu);
+    size_t received = 0;
+    while (received < kMessages) {
+      if (ring->read().first) {
+        ++received;
+      } else {
+        std::this_thread::yield();
+      }
+    }
+  });
+
+  set_cpu_affinity(kProducerCpu);
+  std::string message(msg_size, 'x');
+  auto start = now_ns();
+  for (size_t i = 0; i < kMessages; ++i) {
+    ring->write(message.data(), message.size());
+  }
+  consumer.join();
+
+  char name[64];
+  snprintf(name, sizeof(name), "ring ring_string_buffer spsc size=%zu", msg_size);
+  print_throughput(name, kMessages, kMessages * msg_size, now_ns() - start);
+}
+
+void object_pool_throughput() {
+  struct obj {
+    char data[256];
+  };
+  // two pools side by side, one per thread, the way socket_service holds its http and socket pools
+  std::unique_ptr<object_pool<obj>> pools[2] = {
+      std::unique_ptr<object_pool<obj>>(new object_pool<obj>(64, 64)),
+      std::unique_ptr<object_pool<obj>>(new object_pool<obj>(64, 64))};
+
+  auto run = [&pools](int index, int32_t cpu) {
+    set_cpu_affinity(cpu);
+    auto& pool = *pools[index];
+    for (size_t i = 0; i < kPoolOps; ++i) {
+      pool.release_obj(pool.get_obj());
+    }
+  };
+
+  auto start = now_ns();
+  std::thread other(run, 1, kConsumerCpu);
+  run(0, kProducerCpu);
+  other.join();
+  print_throughput("ring object_pool get/release x2 threads", kPoolOps * 2, 0, now_ns() - start);
+}
+
+}
+
+namespace slick {
+namespace net {
+namespace bench {
+
+void ring_bench() {
+  if (std::thread::hardware_concurrency() < 2) {
+    printf("ring benchmarks need 2 cores to show cross-core effects, results are single core\n");
+  }
+
+  ring_buffer_throughput();
+  for (size_t msg_size : {16, 64, 256}) {
+    ring_string_buffer_throughput(msg_size);
+  }
+  object_pool_throughput();
+}
+
+}
+}
+}
@@ -0,0 +1,118 @@
+/***
+ *  MIT License
+ *
+ *  Copyright (c) 2021 SlickTech <support@slicktech.org>
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ */
+
+#include "benchmarks.h"
+#include "bench_utils.h"
+#include "ring_buffer.h"
+#include <memory>
+
+using namespace slick::net;
+using namespace slick::net::bench;
+
+namespace {
+
+constexpr size_t kMessagesPerProducer = 200000;
+constexpr size_t kBufferSize = 1 << 20;
+constexpr size_t kDrainBatch = 16384;
+
+/**
+ * Producers send into one connection's send buffer while a consumer thread drains it
+ * the way the service thread does. Compares the lock free multi producer path with
+ * serializing producers through an external mutex.
+ */
+void run(size_t msg_size, size_t producers, bool use_mutex) {
+  ring_string_buffer buffer(kBufferSize);
+  std::mutex mutex;
+  std::atomic_size_t running{producers};
+  std::atomic_bool go{false};
+
+  std::thread consumer([&]() {
+    std::vector<char> batch(kDrainBatch);
+    while (running.load(std::memory_order_acquire) || buffer.queued()) {
+      if (!buffer.read_into(batch.data(), batch.size()) && !buffer.read().first) {
+        std::this_thread::yield();
+      }
+    }
+  });
+
+  std::vector<latency_stats> stats(producers);
+  std::vector<std::thread> threads;
+  for (size_t p = 0; p < producers; ++p) {
+    threads.emplace_back([&, p]() {
+      std::string message(msg_size, 'x');
+      auto& stat = stats[p];
+      stat.reserve(kMessagesPerProducer);
+      wait_until([&go]() { return go.load(std::memory_order_acquire); });
+      for (size_t i = 0; i < kMessagesPerProducer; ++i) {
+        auto start = now_ns();
+        if (use_mutex) {
+          std::lock_guard<std::mutex> g(mutex);
+          buffer.write(message.data(), message.size());
+        } else {
+          buffer.write(message.data(), message.size());
+        }
+        stat.add(now_ns() - start);
+      }
+      running.fetch_sub(1, std::memory_order_release);
+    });
+  }
+
+  auto start = now_ns();
+  go.store(true, std::memory_order_release);
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  auto elapsed = now_ns() - start;
+  consumer.join();
+
+  latency_stats latency;
+  for (auto& stat : stats) {
+    latency.merge(stat);
+  }
+
+  char name[64];
+  auto total = kMessagesPerProducer * producers;
+  snprintf(name, sizeof(name), "send %s size=%zu producers=%zu", use_mutex ? "mutex" : "mpsc", msg_size, producers);
+  print_throughput(name, total, total * msg_size, elapsed);
+  latency.print(name);
+}
+
+}
+
+namespace slick {
+namespace net {
+namespace bench {
+
+void send_bench() {
+  for (size_t msg_size : {64, 512}) {
+    for (size_t producers : {1, 2, 4, 8}) {
+      run(msg_size, producers, true);
+      run(msg_size, producers, false);
+    }
+  }
+}
+
+}
+}
+}
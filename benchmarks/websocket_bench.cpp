@@ -0,0 +1,105 @@
+/***
+ *  MIT License
+ *
+ *  Copyright (c) 2021 SlickTech <support@slicktech.org>
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ */
+
+#include "benchmarks.h"
+#include "bench_utils.h"
+#include <slicksocket/websocket_client.h>
+#include <memory>
+
+using namespace slick::net;
+using namespace slick::net::bench;
+
+namespace {
+
+constexpr int32_t kPort = 18081;
+constexpr size_t kRttIterations = 5000;
+constexpr size_t kThroughputMessages = 50000;
+
+void run(size_t msg_size, size_t connections) {
+  std::vector<std::unique_ptr<echo_driver>> drivers;
+  std::vector<std::unique_ptr<websocket_client>> clients;
+  for (size_t i = 0; i < connections; ++i) {
+    drivers.emplace_back(new echo_driver());
+    clients.emplace_back(new websocket_client(drivers.back().get(), "ws://127.0.0.1:" + std::to_string(kPort) + "/"));
+    auto client = clients.back().get();
+    drivers.back()->set_sender([client](const char* msg, size_t len) { return client->send(msg, len); });
+    client->connect();
+  }
+
+  for (auto& driver : drivers) {
+    wait_until([&driver]() { return driver->connected(); });
+  }
+
+  char name[64];
+  latency_stats rtt;
+  for (auto& driver : drivers) {
+    driver->start_rtt(msg_size, kRttIterations);
+  }
+  for (auto& driver : drivers) {
+    wait_until([&driver]() { return driver->done(); });
+    rtt.merge(driver->rtt());
+  }
+  snprintf(name, sizeof(name), "websocket rtt size=%zu conns=%zu", msg_size, connections);
+  rtt.print(name);
+
+  // keep in flight messages well inside the 8K send buffer
+  auto window = std::max<size_t>(1, 4096 / (msg_size + LWS_PRE + 5));
+  auto start = now_ns();
+  for (auto& driver : drivers) {
+    driver->start_throughput(msg_size, kThroughputMessages, window);
+  }
+  for (auto& driver : drivers) {
+    wait_until([&driver]() { return driver->done(); });
+  }
+  auto elapsed = now_ns() - start;
+  snprintf(name, sizeof(name), "websocket throughput size=%zu conns=%zu", msg_size, connections);
+  print_throughput(name, kThroughputMessages * connections, kThroughputMessages * connections * msg_size, elapsed);
+
+  for (auto& client : clients) {
+    client->stop();
+  }
+}
+
+}
+
+namespace slick {
+namespace net {
+namespace bench {
+
+void websocket_bench() {
+  local_ws_echo_server server(kPort);
+  if (!server.ready()) {
+    return;
+  }
+
+  for (size_t msg_size : {64, 512, 4096}) {
+    for (size_t connections : {1, 4, 16}) {
+      run(msg_size, connections);
+    }
+  }
+}
+
+}
+}
+}
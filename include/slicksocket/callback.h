@@ -24,6 +24,8 @@
 
 #pragma once
 
+#include <cstdint>
+
 namespace slick {
 namespace net {
 
@@ -57,9 +59,35 @@ class client_callback_t {
    *
    * @param data        Data string
    * @param len         Current data length
-   * @param remaining   How many data remains
+   * @param remaining   How many data remains. Always 0 with websocket_client::set_reassemble(true),
+   *                    data then holds a whole message and is only valid during the call.
    */
   virtual void on_data(const char* data, size_t len, size_t remaining) = 0;
+
+  /**
+   * on_send_buffer_high invoked on the sending thread when queued bytes reach
+   * send_buffer_options::high_watermark
+   *
+   * @param queued      Bytes queued in the send buffer
+   */
+  virtual void on_send_buffer_high(size_t queued) {}
+
+  /**
+   * on_send_buffer_low invoked on the service thread when queued bytes drop to
+   * send_buffer_options::low_watermark after reaching the high watermark
+   *
+   * @param queued      Bytes queued in the send buffer
+   */
+  virtual void on_send_buffer_low(size_t queued) {}
+
+  /**
+   * on_reconnecting invoked on the service thread when a reconnect attempt is scheduled,
+   * see reconnect_options. Registered subscriptions are replayed before on_connected.
+   *
+   * @param attempt     Attempt number, starting at 1
+   * @param delay_ms    Delay before the attempt is made
+   */
+  virtual void on_reconnecting(uint32_t attempt, uint32_t delay_ms) {}
 };
 
 class socket_server_callback_t {
@@ -90,6 +118,18 @@ class socket_server_callback_t {
    * @param remaining   How many data remains
    */
   virtual void on_data(void* client_handle, const char* data, size_t len) = 0;
+
+  /**
+   * on_send_buffer_high invoked on the sending thread when bytes queued for the client reach
+   * send_buffer_options::high_watermark
+   */
+  virtual void on_send_buffer_high(void* client_handle, size_t queued) {}
+
+  /**
+   * on_send_buffer_low invoked on the service thread when bytes queued for the client drop to
+   * send_buffer_options::low_watermark after reaching the high watermark
+   */
+  virtual void on_send_buffer_low(void* client_handle, size_t queued) {}
 };
 
 }
@@ -0,0 +1,200 @@
+/***
+ *  MIT License
+ *
+ *  Copyright (c) 2021 SlickTech <support@slicktech.org>
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ */
+
+
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "service_options.h"
+#include "websocket_client.h"
+
+namespace slick {
+namespace net {
+
+class client_callback_t;
+class service_group;
+class feed_line;
+
+/**
+ * Extracts the sequence number of a feed message.
+ * @param data    Whole message
+ * @param len     Message length
+ * @return        Sequence number. 0 if the message has none, such messages are delivered from every line.
+ */
+using sequence_extractor = std::function<uint64_t(const char* data, size_t len)>;
+
+/**
+ * Sequence numbers delivered so far, used by feed_group to drop duplicates.
+ * Remembers the highest sequence and the 64 below it. Not thread safe.
+ */
+class sequence_window {
+  uint64_t head_ = 0;     // highest sequence accepted
+  uint64_t window_ = 0;   // bit n set if sequence head_ - n was accepted
+
+ public:
+  /**
+   * Mark a sequence delivered
+   * @param seq   Sequence number. 0 is always accepted and not recorded.
+   * @return      True if it was not accepted before and is less than 64 behind the highest. Otherwise False.
+   */
+  bool accept(uint64_t seq) noexcept;
+
+  /**
+   * Forget all accepted sequences
+   */
+  void reset() noexcept {
+    head_ = 0;
+    window_ = 0;
+  }
+
+  /**
+   * Highest sequence accepted, 0 if none
+   */
+  uint64_t head() const noexcept { return head_; }
+};
+
+/**
+ * Redundant WebSocket connections to the same feed (A/B lines).
+ * Subscriptions are sent on every line and each sequenced message is delivered once,
+ * from whichever line received it first, through a single callback.
+ *
+ * Callbacks are serialized, the callback is never invoked concurrently.
+ * on_connected is invoked when the first line connects and on_disconnected when the last one drops.
+ * Messages are delivered whole, see websocket_client::set_reassemble.
+ *
+ * A message is dropped as a duplicate if its sequence was delivered already, or is more than
+ * 64 behind the highest delivered. Within that window a copy filling a gap on the faster
+ * line is still delivered, out of order.
+ */
+class feed_group {
+  client_callback_t* callback_;
+  sequence_extractor extractor_;
+  std::vector<std::unique_ptr<feed_line>> lines_;
+  std::mutex lock_;
+  sequence_window sequences_;
+  uint32_t connected_ = 0;  // lines connected
+  std::vector<uint64_t> wins_;
+
+ public:
+  /**
+   * Constructor, each line runs on its own service thread
+   * @param callback        Callback receiving the arbitrated feed
+   * @param urls            WebSocket url of each line
+   * @param extractor       Extracts the sequence number of a message
+   * @param origin          Origin of the requests
+   * @param ca_file_path    ssl certificate file path. Default to "".
+   * @param options         Service thread options of every line.
+   */
+  feed_group(client_callback_t* callback,
+             const std::vector<std::string>& urls,
+             sequence_extractor extractor,
+             std::string origin = "",
+             std::string ca_file_path = "",
+             const service_options& options = service_options());
+
+  /**
+   * Constructor using service threads from a service_group, line i is assigned with shard key i
+   * @param callback        Callback receiving the arbitrated feed
+   * @param urls            WebSocket url of each line
+   * @param extractor       Extracts the sequence number of a message
+   * @param origin          Origin of the requests
+   * @param group           Service group to run on. Must outlive the feed_group.
+   */
+  feed_group(client_callback_t* callback,
+             const std::vector<std::string>& urls,
+             sequence_extractor extractor,
+             std::string origin,
+             service_group& group);
+
+  /**
+   * Stops all lines and waits until no service thread calls back into them
+   */
+  virtual ~feed_group() noexcept;
+
+  feed_group(const feed_group&) = delete;
+  feed_group& operator=(const feed_group&) = delete;
+
+  /**
+   * Number of lines
+   */
+  size_t size() const noexcept { return lines_.size(); }
+
+  /**
+   * The client of a line, e.g. to set its reconnect or ping options or read its round trip time
+   */
+  websocket_client& line(size_t index) noexcept;
+
+  /**
+   * Number of messages each line delivered first. Not to be called from the callback.
+   */
+  std::vector<uint64_t> wins();
+
+  /**
+   * Forget delivered sequence numbers, e.g. after the venue restarted its sequence
+   */
+  void reset_sequence() noexcept;
+
+  /**
+   * Register a message sent on every line whenever it connects. See websocket_client::add_subscription.
+   */
+  void add_subscription(const char* msg, size_t len, ws_opcode opcode = ws_opcode::text);
+
+  /**
+   * Remove all registered subscription messages
+   */
+  void clear_subscriptions() noexcept;
+
+  /**
+   * Connect all lines
+   * @return False if any line failed to start connecting. Otherwise True.
+   */
+  bool connect() noexcept;
+
+  /**
+   * Stop all lines
+   */
+  void stop() noexcept;
+
+  /**
+   * Send a message on every line
+   * @return True if it was queued on at least one line.
+   */
+  bool send(const char* msg, size_t len, ws_opcode opcode = ws_opcode::text) noexcept;
+
+ private:
+  friend class feed_line;
+
+  void on_line_connected(feed_line& line);
+  void on_line_disconnected(feed_line& line);
+  void on_line_error(const char* msg, size_t len);
+  void on_line_data(size_t index, const char* data, size_t len);
+};
+
+}
+}
@@ -26,11 +26,15 @@
 #define SLICK_HTTP_CLIENT_H
 
 #include <string>
+#include <algorithm>
+#include <cctype>
 #include <unordered_map>
 #include <functional>
 #include <sstream>
 #include <memory>
 #include <thread>
+#include <vector>
+#include "service_options.h"
 
 namespace slick {
 namespace net {
@@ -42,9 +46,12 @@ struct http_request {
  private:
   std::string body_;
   std::string content_type_;
+  const char* body_view_ = nullptr;
+  size_t body_size_ = 0;
+  int body_fd_ = -1;
 
   /**
-    * NOTE: Header name must end with ":"
+    * NOTE: Header name must end with ":" and be lower case (required by HTTP/2)
     */
   std::unordered_map<std::string, std::string> headers_;
 
@@ -60,6 +67,7 @@ struct http_request {
     if (key.back() != ':') {
       key.append(":");
     }
+    std::transform(key.begin(), key.end(), key.begin(), [](unsigned char c) { return std::tolower(c); });
     headers_.emplace(std::move(key), std::move(value));
   }
 
@@ -70,6 +78,40 @@ struct http_request {
    */
   void add_body(std::string body, std::string content_type) noexcept {
     body_ = std::move(body);
+    body_view_ = nullptr;
+    body_size_ = body_.size();
+    body_fd_ = -1;
+    content_type_ = std::move(content_type);
+  }
+
+  /**
+   * Add request body without copying it, e.g. a mmap'd region.
+   * NOTE: The memory must stay valid until the request completes.
+   * @param data            Body content
+   * @param len             Body length
+   * @param content_type    Content type
+   */
+  void add_body(const char* data, size_t len, std::string content_type) noexcept {
+    body_.clear();
+    body_view_ = data;
+    body_size_ = len;
+    body_fd_ = -1;
+    content_type_ = std::move(content_type);
+  }
+
+  /**
+   * Add request body read from a file descriptor.
+   * Body is read from the current file offset as the request is sent.
+   * NOTE: The descriptor is not closed and must stay open until the request completes.
+   * @param fd              File descriptor to read from
+   * @param len             Number of bytes to send
+   * @param content_type    Content type
+   */
+  void add_body_fd(int fd, size_t len, std::string content_type) noexcept {
+    body_.clear();
+    body_view_ = nullptr;
+    body_size_ = len;
+    body_fd_ = fd;
     content_type_ = std::move(content_type);
   }
 
@@ -81,10 +123,30 @@ struct http_request {
 
   /**
    * Request Body
-   * @return Request body content
+   * @return Request body content. Empty if body is a view or file descriptor.
    */
   const std::string& body() const noexcept { return body_; }
 
+  /**
+   * Request Body Data
+   * @return Pointer to body content. nullptr if body is read from a file descriptor.
+   */
+  const char* body_data() const noexcept {
+    return body_view_ ? body_view_ : (body_fd_ == -1 ? body_.data() : nullptr);
+  }
+
+  /**
+   * Request Body Size
+   * @return Body length in bytes
+   */
+  size_t body_size() const noexcept { return body_size_; }
+
+  /**
+   * Request Body File Descriptor
+   * @return File descriptor body is read from. -1 if none.
+   */
+  int body_fd() const noexcept { return body_fd_; }
+
   /**
    * Content Type
    * @return Request body content type
@@ -104,8 +166,20 @@ struct http_response {
       : status(stat), content_type(std::move(type)), response_text(std::move(response)) {}
 };
 
+/**
+ * Asynchronous request submitted as part of a batch. See http_client::request(std::vector<http_async_request>&&).
+ */
+struct http_async_request {
+  const char* method;                           // all UPPER CASE
+  std::string path;
+  std::shared_ptr<http_request> request;        // might be nullptr
+  std::function<void(http_response)> callback;
+};
+
 // forward declaration
 class socket_service;
+class service_group;
+struct request_info;
 
 /**
  * HTTP Client
@@ -114,26 +188,54 @@ class http_client {
   socket_service* service_;
   std::string address_;
   std::string origin_;
-  int16_t port_ = -1;
+  int32_t port_ = -1;
+  bool use_ssl_ = false;
+
+  http_client(std::string address, std::string origin, socket_service* service) noexcept;
+
+  request_info* make_async_request(const char* method, std::string path);
 
  public:
   using AsyncCallback = std::function<void(http_response)>;
 
+  /**
+   * Streaming callback
+   * @param status      HTTP response status. 0 if no response was received.
+   * @param data        Response body chunk. On final call, error message if any.
+   * @param len         Chunk length
+   * @param final       True on the last call for the request, after which no more data arrives.
+   */
+  using StreamCallback = std::function<void(int32_t status, const char* data, size_t len, bool final)>;
+
   /**
    * Constructor
-   * @param address             Request domain url.
+   * @param address             Request domain url. https:// uses TLS, plain HTTP otherwise.
    * @param origin              The Origin of http request. Default to "".
    * @param ca_file_path        ssl certificate file path. Default to "".
    *                            In most of case, system should be able to find a suitable ssl certificate.
    *                            If it can't find ssl certificate, pass in ca_file_path to specify a ssl certificate file.
    * @param cpu_affinity        Pin service thread to specified CPU. Default to -1 means not pin to specific CPU.
    * @param use_global_thread   Use
+   * @param options             Service thread options. See service_options.
    */
   http_client(std::string address,
               std::string origin = "",
               std::string ca_file_path = "",
               int32_t cpu_affinity = -1,
-              bool use_global_thread = false) noexcept;
+              bool use_global_thread = false,
+              const service_options& options = service_options()) noexcept;
+
+  /**
+   * Constructor using a service thread from a service_group
+   * @param address             Request domain url.
+   * @param origin              The Origin of http request.
+   * @param group               Service group to run on. Must outlive the client.
+   * @param shard_key           Shard key passed to the group's shard policy
+   */
+  http_client(std::string address,
+              std::string origin,
+              service_group& group,
+              uint64_t shard_key = 0) noexcept;
 
   virtual ~http_client() noexcept;
 
@@ -172,6 +274,35 @@ class http_client {
    */
   void request(const char* method, std::string path, const std::shared_ptr<http_request>& request, AsyncCallback&& callback);
 
+  /**
+   * Asynchronous Requests submitted together
+   *
+   * All requests are handed to the service thread with a single publish and one wakeup,
+   * which is cheaper than issuing them one by one.
+   *
+   * @param requests    Requests to send. Each callback is invoked once its response arrives.
+   */
+  void request(std::vector<http_async_request>&& requests);
+
+  // Streaming requests
+
+  /**
+   * Streaming Request
+   *
+   * Response body is delivered chunk by chunk on the service thread as it arrives,
+   * without being accumulated. Chunks are only valid during the callback.
+   *
+   * @param method      HTTP request method. e.g. "GET", "POST', "PUT", "DELETE" etc.
+   *                    NOTE: method must be all UPPER CASE
+   * @param path        Request path.
+   * @param request     Http request struct. Might be nullptr.
+   * @param callback    Streaming callback function.
+   */
+  void request_stream(const char* method,
+                      std::string path,
+                      const std::shared_ptr<http_request>& request,
+                      StreamCallback&& callback);
+
 };
 
 
@@ -0,0 +1,117 @@
+/***
+ *  MIT License
+ *
+ *  Copyright (c) 2021 SlickTech <support@slicktech.org>
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+#include "service_options.h"
+
+namespace slick {
+namespace net {
+
+class socket_service;
+
+/**
+ * How service_group assigns a connection to a service thread
+ */
+enum class shard_policy : uint8_t {
+  round_robin,    // cycle through service threads
+  least_loaded,   // service thread with fewest clients attached
+  shard_key,      // shard_key % number of service threads
+};
+
+/**
+ * Custom shard selector.
+ * @param shard_key     Shard key passed by the client
+ * @param loads         Number of clients attached to each service thread
+ * @return              Index of the service thread to use
+ */
+using shard_selector = std::function<size_t(uint64_t shard_key, const std::vector<uint32_t>& loads)>;
+
+/**
+ * A group of service threads, each with its own lws context.
+ * Clients constructed with a service_group are spread across its threads.
+ *
+ * NOTE: service_group must outlive all clients assigned to it.
+ */
+class service_group {
+  std::vector<socket_service*> services_;
+  shard_policy policy_ = shard_policy::round_robin;
+  shard_selector selector_ = nullptr;
+  std::atomic<uint64_t> next_{0};
+
+ public:
+  /**
+   * Constructor
+   * @param num_services    Number of service threads. 0 is treated as 1.
+   * @param policy          How connections are assigned to service threads
+   * @param ca_file_path    ssl certificate file path. Default to "".
+   * @param cpu_affinities  CPU to pin each service thread to. Threads without an entry are not pinned.
+   * @param options         Service thread options applied to every thread.
+   */
+  service_group(size_t num_services,
+                shard_policy policy = shard_policy::round_robin,
+                const std::string& ca_file_path = "",
+                const std::vector<int32_t>& cpu_affinities = {},
+                const service_options& options = service_options());
+
+  /**
+   * Constructor with custom shard selector
+   * @param num_services    Number of service threads. 0 is treated as 1.
+   * @param selector        Picks the service thread for a connection
+   * @param ca_file_path    ssl certificate file path. Default to "".
+   * @param cpu_affinities  CPU to pin each service thread to. Threads without an entry are not pinned.
+   * @param options         Service thread options applied to every thread.
+   */
+  service_group(size_t num_services,
+                shard_selector selector,
+                const std::string& ca_file_path = "",
+                const std::vector<int32_t>& cpu_affinities = {},
+                const service_options& options = service_options());
+
+  virtual ~service_group() noexcept;
+
+  service_group(const service_group&) = delete;
+  service_group& operator=(const service_group&) = delete;
+
+  /**
+   * Number of service threads
+   */
+  size_t size() const noexcept { return services_.size(); }
+
+  /**
+   * Number of clients attached to each service thread
+   */
+  std::vector<uint32_t> loads() const;
+
+  // This is for internal use only
+  socket_service* assign(uint64_t shard_key) noexcept;
+};
+
+}
+}
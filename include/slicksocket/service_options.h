@@ -0,0 +1,314 @@
+/***
+ *  MIT License
+ *
+ *  Copyright (c) 2021 SlickTech <support@slicktech.org>
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ */
+
+#pragma once
+
+#include <cstdint>
+
+namespace slick {
+namespace net {
+
+/**
+ * How the service thread waits for work
+ */
+enum class wait_strategy : uint8_t {
+  /**
+   * Never sleep. Idle service spins on the request queue and
+   * active connections are polled without blocking.
+   * Lowest latency, always burns a full core.
+   */
+  busy_spin,
+
+  /**
+   * Spin for a short while when idle, then park the service thread
+   * until a new request is published.
+   * Active connections block in poll until an event arrives.
+   */
+  spin_then_park,
+
+  /**
+   * Park immediately when idle and block in poll when active.
+   * Lowest CPU usage.
+   */
+  blocking,
+};
+
+/**
+ * What send does when the connection's send buffer is full
+ */
+enum class overflow_policy : uint8_t {
+  /**
+   * Wait until the service thread frees enough space.
+   */
+  block,
+
+  /**
+   * Fail immediately, send returns false.
+   */
+  fail,
+
+  /**
+   * Discard the oldest queued messages to make room.
+   * Dropping a fragment of a partly sent WebSocket message corrupts that message.
+   */
+  drop_oldest,
+
+  /**
+   * Wait up to send_buffer_options::block_timeout_us, then fail.
+   */
+  block_with_timeout,
+};
+
+/**
+ * Per connection send buffer options
+ */
+struct send_buffer_options {
+  /**
+   * Send ring size in bytes, rounded up to a power of 2.
+   * Messages that don't fit in the ring are queued in order on the heap instead.
+   */
+  uint32_t size = 8192;
+
+  overflow_policy overflow = overflow_policy::block;
+
+  /**
+   * Max time to wait for space with overflow_policy::block_with_timeout, in microseconds.
+   */
+  uint32_t block_timeout_us = 1000;
+
+  /**
+   * Queued bytes at which client_callback_t::on_send_buffer_high is invoked. 0 disables watermarks.
+   */
+  uint32_t high_watermark = 0;
+
+  /**
+   * Queued bytes at which client_callback_t::on_send_buffer_low is invoked once the high watermark was reached.
+   */
+  uint32_t low_watermark = 0;
+};
+
+/**
+ * Automatic reconnect of WebSocket and raw socket clients
+ */
+struct reconnect_options {
+  /**
+   * Reconnect when the connection drops or fails, until stop() is called.
+   */
+  bool enabled = false;
+
+  /**
+   * Delay before the first attempt, in milliseconds. Doubles on every failed attempt.
+   */
+  uint32_t initial_delay_ms = 100;
+
+  /**
+   * Upper bound of the delay between attempts, in milliseconds.
+   */
+  uint32_t max_delay_ms = 30000;
+
+  /**
+   * Random spread of each delay in percent, so clients dropped together don't reconnect in lockstep.
+   */
+  uint8_t jitter_percent = 20;
+
+  /**
+   * Give up after this many consecutive failed attempts. 0 retries forever.
+   */
+  uint32_t max_attempts = 0;
+
+  /**
+   * Retry the address the last connection was established to first, skipping name resolution.
+   * Later attempts resolve the host again in case it moved.
+   */
+  bool reuse_resolved_address = true;
+
+  /**
+   * Delay before the next attempt: initial_delay_ms doubled per failed attempt, capped at max_delay_ms,
+   * then spread by jitter_percent.
+   * @param attempts  Consecutive attempts made so far
+   * @param random    Random number picking the point within the jitter spread
+   * @return          Delay in milliseconds
+   */
+  uint64_t delay_ms(uint32_t attempts, uint64_t random) const noexcept {
+    uint64_t delay = initial_delay_ms;
+    for (uint32_t i = 0; i < attempts && delay < max_delay_ms; ++i) {
+      delay <<= 1;
+    }
+    if (delay > max_delay_ms) {
+      delay = max_delay_ms;
+    }
+    uint64_t jitter = jitter_percent < 100 ? jitter_percent : 100;
+    if (jitter && delay) {
+      auto spread = delay * jitter / 100;
+      delay = delay - spread + random % (2 * spread + 1);
+    }
+    return delay;
+  }
+};
+
+/**
+ * WebSocket ping/pong liveness check and round trip measurement
+ */
+struct ping_options {
+  /**
+   * Send a ping every interval_ms while connected. 0 disables pings.
+   */
+  uint32_t interval_ms = 0;
+
+  /**
+   * Close the connection if the pong is not received within timeout_ms of its ping,
+   * so a dead connection fails over (see reconnect_options) instead of waiting for TCP keepalive.
+   * 0 never times out.
+   */
+  uint32_t timeout_ms = 0;
+};
+
+/**
+ * permessage-deflate (RFC 7692) options of WebSocket clients.
+ * Requires libwebsockets built with extensions (LWS_WITHOUT_EXTENSIONS=OFF).
+ */
+struct ws_compression_options {
+  /**
+   * Offer permessage-deflate when connecting. Messages are only compressed if the server accepts it.
+   */
+  bool enabled = false;
+
+  /**
+   * LZ77 window bits, 8 to 15, the server may use for messages it sends us.
+   * Smaller windows need less memory per connection and compress worse.
+   */
+  uint8_t server_max_window_bits = 15;
+
+  /**
+   * LZ77 window bits, 8 to 15, used for messages we send.
+   */
+  uint8_t client_max_window_bits = 15;
+
+  /**
+   * Ask the server to reset its compression context after every message.
+   * Costs ratio on repetitive feeds, saves the window memory between messages.
+   */
+  bool server_no_context_takeover = false;
+
+  /**
+   * Reset our compression context after every message we send.
+   */
+  bool client_no_context_takeover = false;
+};
+
+/**
+ * Service thread options
+ */
+struct service_options {
+  /**
+   * How the service thread waits for work.
+   */
+  wait_strategy strategy = wait_strategy::spin_then_park;
+
+  service_options() = default;
+
+  /**
+   * Default options with the given wait strategy. Implicit so clients constructed with a wait_strategy still compile.
+   */
+  service_options(wait_strategy s) noexcept : strategy(s) {}
+
+  /**
+   * Max number of queued requests to start per service loop iteration.
+   * 0 means drain all published requests at once.
+   * Set a cap to bound the time between lws_service calls under a request burst.
+   */
+  uint32_t max_requests_per_poll = 0;
+
+  /**
+   * Max number of finished requests kept for reuse, per request kind (http or socket).
+   * Requests are allocated on demand, a full pool frees finished requests instead.
+   */
+  uint32_t request_pool_size = 256;
+
+  /**
+   * Number of requests allocated up front, per request kind.
+   */
+  uint32_t request_pool_reserve = 0;
+
+  /**
+   * Keep the HTTP connection open after a request completes and reuse it for later
+   * requests to the same host, port and TLS setting instead of reconnecting.
+   *
+   * This is not a connection pool. libwebsockets pipelines requests onto a single
+   * connection per endpoint: over HTTP/1.1 requests issued while it is busy wait for
+   * the ones ahead of them, there is no parallelism per host. Use http2 or spread the
+   * clients over several services for concurrent requests.
+   * A connection the peer closes while idle is dropped and the next request reconnects.
+   */
+  bool http_keep_alive = false;
+
+  /**
+   * Seconds the idle keep-alive connection stays open before it is closed.
+   */
+  uint16_t http_idle_timeout = 5;
+
+  /**
+   * Negotiate HTTP/2 over TLS and run concurrent requests to the same host as streams
+   * on one connection. Falls back to HTTP/1.1 if the server doesn't support h2.
+   * Implies http_keep_alive.
+   */
+  bool http2 = false;
+
+  /**
+   * Initial HTTP/2 receive window per stream in bytes. The window is replenished as
+   * response data is consumed. 0 leaves the window to libwebsockets defaults.
+   */
+  int32_t http2_stream_window = 0;
+
+  /**
+   * Max bytes of queued raw socket messages gathered into a single write.
+   * Messages larger than the budget are written on their own.
+   * 0 writes one message per writeable event.
+   */
+  uint32_t socket_write_batch = 16384;
+
+  /**
+   * Send buffer options of the WebSocket and raw socket clients running on the service.
+   */
+  send_buffer_options send_buffer;
+
+  /**
+   * permessage-deflate offered by the WebSocket clients running on the service.
+   * Extensions are negotiated per lws context, so it applies to all of them.
+   */
+  ws_compression_options ws_compression;
+
+  /**
+   * Ping options of the WebSocket clients running on the service.
+   */
+  ping_options ws_ping;
+
+  /**
+   * Reconnect options of the WebSocket and raw socket clients running on the service.
+   */
+  reconnect_options reconnect;
+};
+
+}
+}
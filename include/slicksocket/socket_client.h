@@ -27,13 +27,17 @@
 #include <cstdint>
 #include <string>
 #include <functional>
+#include <memory>
+#include "service_options.h"
 
 namespace slick {
 namespace net {
 
 class client_callback_t;
 class socket_service;
+class service_group;
 struct request_info;
+struct subscription_list;
 
 class socket_client {
   client_callback_t* callback_;
@@ -41,15 +45,64 @@ class socket_client {
   request_info* request_ = nullptr;
   uint32_t port_;
   std::string address_;
+  send_buffer_options send_buffer_;
+  reconnect_options reconnect_;
+  std::shared_ptr<subscription_list> subscriptions_;
+
+  socket_client(client_callback_t *callback,
+                std::string address,
+                uint32_t port,
+                socket_service* service);
 
  public:
   socket_client(client_callback_t *callback,
                 std::string address,
                 uint32_t port,
                 int32_t cpu_affinity = -1,
-                bool use_global_thread = false);
+                bool use_global_thread = false,
+                const service_options& options = service_options());
+
+  /**
+   * Constructor using a service thread from a service_group
+   * @param callback    Client callback
+   * @param address     Server address
+   * @param port        Server port
+   * @param group       Service group to run on. Must outlive the client.
+   * @param shard_key   Shard key passed to the group's shard policy
+   */
+  socket_client(client_callback_t *callback,
+                std::string address,
+                uint32_t port,
+                service_group& group,
+                uint64_t shard_key = 0);
   virtual ~socket_client();
 
+  /**
+   * Set the send buffer size, overflow policy and watermarks. Takes effect on the next connect().
+   * Defaults to service_options::send_buffer.
+   */
+  void set_send_buffer(const send_buffer_options& options) noexcept { send_buffer_ = options; }
+
+  /**
+   * Set automatic reconnect options. Takes effect on the next connect().
+   * Defaults to service_options::reconnect.
+   */
+  void set_reconnect(const reconnect_options& options) noexcept { reconnect_ = options; }
+
+  /**
+   * Register a message sent first thing whenever the connection is established,
+   * on connect() and on every automatic reconnect, in registration order.
+   * It is not sent on the current connection, use send() for that.
+   * @param msg     The message
+   * @param len     The length of the message
+   */
+  void add_subscription(const char* msg, size_t len);
+
+  /**
+   * Remove all registered subscription messages
+   */
+  void clear_subscriptions() noexcept;
+
   /**
    * Connect to WebSocket server
    * @return False if error occurred. Otherwise True.
@@ -62,12 +115,29 @@ class socket_client {
   void stop() noexcept;
 
   /**
-   * Send message to WebSocket server
+   * Send message to the server. Safe to call from multiple threads.
    * @param msg     The message to send
    * @param len     The length of the message
    * @return        True on success. Otherwise False.
    */
   bool send(char* msg, size_t len);
+
+  /**
+   * Reserve space in the send buffer so a message can be serialized in place.
+   * Must be followed by commit() on this client from the same thread before its next prepare(), send() or stop().
+   * send() from that thread fails until then.
+   * Other threads may send or prepare meanwhile, their messages queue behind this one until it is committed.
+   * @param max_len   Maximum length of the message
+   * @return          Buffer of max_len bytes to write the message into. nullptr on failure.
+   */
+  char* prepare(size_t max_len) noexcept;
+
+  /**
+   * Send the message written into the buffer returned by prepare()
+   * @param len   Actual length of the message. 0 discards it.
+   * @return      True on success. False on failure or if this thread has no prepare() pending on this client.
+   */
+  bool commit(size_t len) noexcept;
 };
 
 }
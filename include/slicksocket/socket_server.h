@@ -27,6 +27,10 @@
 #include <thread>
 #include <unordered_map>
 #include <atomic>
+#include <mutex>
+#include "service_options.h"
+
+struct lws_context;
 
 namespace slick {
 namespace net {
@@ -36,19 +40,57 @@ class socket_server_callback_t;
 class socket_server {
   socket_server_callback_t* callback_;
   std::atomic_bool run_{true};
+  lws_context* context_ = nullptr;
+  std::mutex context_mutex_;
+  uint32_t write_batch_;
+  send_buffer_options send_buffer_;
 
  public:
-  socket_server(socket_server_callback_t* callback) noexcept : callback_(callback) {}
+  /**
+   * @param callback      Server callback
+   * @param write_batch   Max bytes of queued messages gathered into a single write to a client.
+   *                      0 writes one message per writeable event.
+   * @param send_buffer   Send buffer options of each client connection
+   */
+  socket_server(socket_server_callback_t* callback,
+                uint32_t write_batch = 16384,
+                const send_buffer_options& send_buffer = send_buffer_options()) noexcept
+    : callback_(callback)
+    , write_batch_(write_batch)
+    , send_buffer_(send_buffer) {}
   virtual ~socket_server() noexcept = default;
 
   void serve(int32_t port, int32_t cpu_affinity = -1);
 
-  void stop() noexcept {
-    run_.store(false, std::memory_order_release);
-  }
+  /**
+   * Stop serving. serve() returns once the service loop wakes up.
+   */
+  void stop() noexcept;
 
+  /**
+   * Send message to a client. Safe to call from multiple threads.
+   */
   bool send(void* client_handle, const char* message, size_t length);
 
+  /**
+   * Reserve space in a client's send buffer so a message can be serialized in place.
+   * Must be followed by commit() with the same client_handle from the same thread before its next prepare() or send().
+   * send() to that client from that thread fails until then.
+   * Other threads may send or prepare meanwhile, their messages queue behind this one until it is committed.
+   * @param client_handle   Client handle passed to socket_server_callback_t
+   * @param max_len         Maximum length of the message
+   * @return                Buffer of max_len bytes to write the message into. nullptr on failure.
+   */
+  char* prepare(void* client_handle, size_t max_len);
+
+  /**
+   * Send the message written into the buffer returned by prepare()
+   * @param client_handle   Client handle passed to prepare()
+   * @param len             Actual length of the message. 0 discards it.
+   * @return                True on success. False on failure or if this thread has no prepare() pending on client_handle.
+   */
+  bool commit(void* client_handle, size_t len);
+
 };
 
 }
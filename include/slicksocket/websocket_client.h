@@ -24,15 +24,28 @@
 
 #pragma once
 
+#include <atomic>
 #include <cstdint>
 #include <string>
 #include <memory>
+#include "service_options.h"
 
 namespace slick {
 namespace net {
 
+/**
+ * WebSocket message frame type
+ */
+enum class ws_opcode : uint8_t {
+  text,
+  binary,
+  continuation,   // next fragment of a message started with final = false
+};
+
 struct request_info;
+struct subscription_list;
 class socket_service;
+class service_group;
 class client_callback_t;
 
 class websocket_client {
@@ -44,6 +57,19 @@ class websocket_client {
   std::string origin_;
   std::string path_;
   int16_t port_ = -1;
+  send_buffer_options send_buffer_;
+  bool reassemble_ = false;
+  size_t max_message_size_ = 0;
+  reconnect_options reconnect_;
+  ping_options ping_;
+  std::shared_ptr<subscription_list> subscriptions_;
+  std::shared_ptr<std::atomic<uint32_t>> held_;   // connections the service thread still holds
+
+ private:
+  websocket_client(client_callback_t *callback,
+                   std::string url,
+                   std::string origin,
+                   socket_service* service);
 
  public:
   websocket_client(client_callback_t *callback,
@@ -51,12 +77,85 @@ class websocket_client {
                    std::string origin = "",
                    std::string ca_file_path = "",
                    int32_t cpu_affinity = -1,
-                   bool use_global_service = false);
+                   bool use_global_service = false,
+                   const service_options& options = service_options());
+
+  /**
+   * Constructor using a service thread from a service_group
+   * @param callback    Client callback
+   * @param url         WebSocket url
+   * @param origin      Origin of the request
+   * @param group       Service group to run on. Must outlive the client.
+   * @param shard_key   Shard key passed to the group's shard policy
+   */
+  websocket_client(client_callback_t *callback,
+                   std::string url,
+                   std::string origin,
+                   service_group& group,
+                   uint64_t shard_key = 0);
 
   virtual ~websocket_client() noexcept;
   
   const std::string& url() const noexcept { return url_; }
 
+  /**
+   * Set the send buffer size, overflow policy and watermarks. Takes effect on the next connect().
+   * Defaults to service_options::send_buffer.
+   */
+  void set_send_buffer(const send_buffer_options& options) noexcept { send_buffer_ = options; }
+
+  /**
+   * Deliver each received message once, whole, instead of fragment by fragment.
+   * Messages arriving in a single fragment are passed through without a copy,
+   * others are collected in a per connection buffer that is reused across messages.
+   * Takes effect on the next connect(). Default to false.
+   * @param enabled             Reassemble messages
+   * @param max_message_size    Largest message in bytes. A larger one is reported through on_error
+   *                            and the connection is closed with status 1009. 0 is unlimited.
+   */
+  void set_reassemble(bool enabled, size_t max_message_size = 0) noexcept {
+    reassemble_ = enabled;
+    max_message_size_ = max_message_size;
+  }
+
+  /**
+   * Set automatic reconnect options. Takes effect on the next connect().
+   * Defaults to service_options::reconnect.
+   */
+  void set_reconnect(const reconnect_options& options) noexcept { reconnect_ = options; }
+
+  /**
+   * Set ping interval and pong timeout. Takes effect on the next connect().
+   * Defaults to service_options::ws_ping.
+   */
+  void set_ping(const ping_options& options) noexcept { ping_ = options; }
+
+  /**
+   * Round trip time of the last ping of the current connection, in nanoseconds. 0 if none yet.
+   */
+  uint64_t last_rtt_ns() const noexcept;
+
+  /**
+   * Smoothed round trip time of the current connection, in nanoseconds. 0 if none yet.
+   * Exponentially weighted, each pong contributes 1/8 like TCP's SRTT.
+   */
+  uint64_t smoothed_rtt_ns() const noexcept;
+
+  /**
+   * Register a message sent first thing whenever the connection is established,
+   * on connect() and on every automatic reconnect, in registration order.
+   * It is not sent on the current connection, use send() for that.
+   * @param msg     The message
+   * @param len     The length of the message
+   * @param opcode  Frame type. Default to text.
+   */
+  void add_subscription(const char* msg, size_t len, ws_opcode opcode = ws_opcode::text);
+
+  /**
+   * Remove all registered subscription messages
+   */
+  void clear_subscriptions() noexcept;
+
   /**
    * Connect to WebSocket server
    * @return False if error occurred. Otherwise True.
@@ -69,12 +168,40 @@ class websocket_client {
   void stop() noexcept;
 
   /**
-   * Send message to WebSocket server
+   * Block until the service thread let go of every connection stopped so far.
+   * The callback is not invoked afterwards, so it can be destroyed even if the service is shared.
+   * Call after stop(), never from the callback.
+   */
+  void wait_stopped() noexcept;
+
+  /**
+   * Send message to WebSocket server. Safe to call from multiple threads.
    * @param msg     The message to send
    * @param len     The length of the message
+   * @param opcode  Frame type. Default to text.
+   * @param final   False if more fragments of this message follow as ws_opcode::continuation.
    * @return        True on success. Otherwise False.
    */
-  bool send(const char* msg, size_t len) noexcept;
+  bool send(const char* msg, size_t len, ws_opcode opcode = ws_opcode::text, bool final = true) noexcept;
+
+  /**
+   * Reserve space in the send buffer so a message can be serialized in place.
+   * Must be followed by commit() on this client from the same thread before its next prepare(), send() or stop().
+   * send() from that thread fails until then.
+   * Other threads may send or prepare meanwhile, their messages queue behind this one until it is committed.
+   * @param max_len   Maximum length of the message
+   * @param opcode    Frame type. Default to text.
+   * @param final     False if more fragments of this message follow as ws_opcode::continuation.
+   * @return          Buffer of max_len bytes to write the message into. nullptr on failure.
+   */
+  char* prepare(size_t max_len, ws_opcode opcode = ws_opcode::text, bool final = true) noexcept;
+
+  /**
+   * Send the message written into the buffer returned by prepare()
+   * @param len   Actual length of the message. 0 discards it.
+   * @return      True on success. False on failure or if this thread has no prepare() pending on this client.
+   */
+  bool commit(size_t len) noexcept;
 };
 
 } // namespace net
@@ -0,0 +1,209 @@
+/***
+ *  MIT License
+ *
+ *  Copyright (c) 2021 SlickTech <support@slicktech.org>
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ */
+
+
+#include "slicksocket/feed_group.h"
+#include "slicksocket/callback.h"
+#include "slicksocket/service_group.h"
+
+namespace slick {
+namespace net {
+
+/**
+ * One connection of a feed_group
+ */
+class feed_line : public client_callback_t {
+  feed_group* group_;
+  size_t index_;
+
+ public:
+  std::unique_ptr<websocket_client> client;
+  bool connected = false;   // guarded by feed_group::lock_
+
+  feed_line(feed_group* group, size_t index) : group_(group), index_(index) {}
+
+  void on_connected() override { group_->on_line_connected(*this); }
+  void on_disconnected() override { group_->on_line_disconnected(*this); }
+  void on_error(const char* msg, size_t len) override { group_->on_line_error(msg, len); }
+  void on_data(const char* data, size_t len, size_t remaining) override { group_->on_line_data(index_, data, len); }
+};
+
+}
+}
+
+using namespace slick::net;
+
+feed_group::feed_group(client_callback_t* callback,
+                       const std::vector<std::string>& urls,
+                       sequence_extractor extractor,
+                       std::string origin,
+                       std::string ca_file_path,
+                       const service_options& options)
+  : callback_(callback)
+  , extractor_(std::move(extractor))
+  , wins_(urls.size(), 0) {
+  for (size_t i = 0; i < urls.size(); ++i) {
+    lines_.emplace_back(new feed_line(this, i));
+    auto& line = *lines_.back();
+    // a service thread per line, so a stalled line can't hold back the others
+    line.client.reset(new websocket_client(&line, urls[i], origin, ca_file_path, -1, false, options));
+    line.client->set_reassemble(true);
+  }
+}
+
+feed_group::feed_group(client_callback_t* callback,
+                       const std::vector<std::string>& urls,
+                       sequence_extractor extractor,
+                       std::string origin,
+                       service_group& group)
+  : callback_(callback)
+  , extractor_(std::move(extractor))
+  , wins_(urls.size(), 0) {
+  for (size_t i = 0; i < urls.size(); ++i) {
+    lines_.emplace_back(new feed_line(this, i));
+    auto& line = *lines_.back();
+    line.client.reset(new websocket_client(&line, urls[i], origin, group, i));
+    line.client->set_reassemble(true);
+  }
+}
+
+feed_group::~feed_group() noexcept {
+  // a shared service thread may still be calling back into a stopped line, wait until it let go
+  stop();
+  for (auto& line : lines_) {
+    line->client->wait_stopped();
+  }
+  lines_.clear();
+}
+
+websocket_client& feed_group::line(size_t index) noexcept {
+  return *lines_[index]->client;
+}
+
+std::vector<uint64_t> feed_group::wins() {
+  std::lock_guard<std::mutex> g(lock_);
+  return wins_;
+}
+
+void feed_group::reset_sequence() noexcept {
+  std::lock_guard<std::mutex> g(lock_);
+  sequences_.reset();
+}
+
+void feed_group::add_subscription(const char* msg, size_t len, ws_opcode opcode) {
+  for (auto& line : lines_) {
+    line->client->add_subscription(msg, len, opcode);
+  }
+}
+
+void feed_group::clear_subscriptions() noexcept {
+  for (auto& line : lines_) {
+    line->client->clear_subscriptions();
+  }
+}
+
+bool feed_group::connect() noexcept {
+  auto ok = true;
+  for (auto& line : lines_) {
+    ok = line->client->connect() && ok;
+  }
+  return ok;
+}
+
+void feed_group::stop() noexcept {
+  for (auto& line : lines_) {
+    line->client->stop();
+  }
+}
+
+bool feed_group::send(const char* msg, size_t len, ws_opcode opcode) noexcept {
+  auto sent = false;
+  for (auto& line : lines_) {
+    sent = line->client->send(msg, len, opcode) || sent;
+  }
+  return sent;
+}
+
+void feed_group::on_line_connected(feed_line& line) {
+  std::lock_guard<std::mutex> g(lock_);
+  if (line.connected) {
+    return;
+  }
+  line.connected = true;
+  if (connected_++ == 0) {
+    callback_->on_connected();
+  }
+}
+
+void feed_group::on_line_disconnected(feed_line& line) {
+  std::lock_guard<std::mutex> g(lock_);
+  // a line failing to connect reports a disconnect it never counted
+  if (!line.connected) {
+    return;
+  }
+  line.connected = false;
+  if (--connected_ == 0) {
+    callback_->on_disconnected();
+  }
+}
+
+void feed_group::on_line_error(const char* msg, size_t len) {
+  std::lock_guard<std::mutex> g(lock_);
+  callback_->on_error(msg, len);
+}
+
+void feed_group::on_line_data(size_t index, const char* data, size_t len) {
+  // extract outside the lock, lines parse concurrently
+  auto seq = extractor_(data, len);
+  std::lock_guard<std::mutex> g(lock_);
+  if (!sequences_.accept(seq)) {
+    return;
+  }
+  ++wins_[index];
+  callback_->on_data(data, len, 0);
+}
+
+bool sequence_window::accept(uint64_t seq) noexcept {
+  if (!seq) {
+    return true;
+  }
+
+  if (seq > head_) {
+    auto shift = seq - head_;
+    window_ = (shift < 64 ? window_ << shift : 0) | 1;
+    head_ = seq;
+    return true;
+  }
+
+  auto behind = head_ - seq;
+  if (behind >= 64) {
+    return false;
+  }
+  auto bit = uint64_t(1) << behind;
+  if (window_ & bit) {
+    return false;
+  }
+  window_ |= bit;
+  return true;
+}
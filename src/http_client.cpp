@@ -23,44 +23,83 @@
  */
 
 #include "slicksocket/http_client.h"
+#include "slicksocket/service_group.h"
 #include "utils.h"
 #include <atomic>
+#include <algorithm>
+#include <cstdlib>
 #include "socket_service.h"
+#if defined(_MSC_VER)
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+#define MAX_RESPONSE_RESERVE (64 * 1024 * 1024)
 
 using namespace slick::net;
 
+namespace {
+
+int64_t read_fd(int fd, void* buf, size_t len) {
+#if defined(_MSC_VER)
+  return _read(fd, buf, (unsigned int)len);
+#else
+  return read(fd, buf, len);
+#endif
+}
+
+}
+
 http_client::http_client(std::string address,
                          std::string origin,
                          std::string ca_file_path,
                          int32_t cpu_affinity,
-                         bool use_global_thread) noexcept
-  : service_(use_global_thread
-      ? socket_service::global(ca_file_path, cpu_affinity) : new socket_service(std::move(ca_file_path), cpu_affinity))
+                         bool use_global_thread,
+                         const service_options& options) noexcept
+  : http_client(std::move(address),
+                std::move(origin),
+                use_global_thread
+                    ? socket_service::global(ca_file_path, cpu_affinity, options)
+                    : new socket_service(std::move(ca_file_path), cpu_affinity, false, options)) {
+}
+
+http_client::http_client(std::string address,
+                         std::string origin,
+                         service_group& group,
+                         uint64_t shard_key) noexcept
+  : http_client(std::move(address), std::move(origin), group.assign(shard_key)) {
+}
+
+http_client::http_client(std::string address, std::string origin, socket_service* service) noexcept
+  : service_(service)
   , address_(std::move(address))
   , origin_(std::move(origin)) {
 
-  auto pos = address_.find(':');
-  bool has_port = pos != 4 && pos !=5 && pos != std::string::npos;
-  if (has_port) {
+  auto pos = address_.find("://");
+  if (pos != std::string::npos) {
+    use_ssl_ = address_.compare(0, pos, "https") == 0;
+    address_ = address_.substr(pos + 3);
+  }
+
+  pos = address_.find(':');
+  if (pos != std::string::npos) {
     port_ = std::stoi(address_.substr(pos + 1));
+    address_ = address_.substr(0, pos);
   }
 
-  if (address_.find("https://") != std::string::npos) {
-    address_ = has_port ? address_.substr(8, pos - 8) : address_.substr(8);
-    if (port_ == -1) {
-      port_ = 443;
-    }
-  } else if (address_.find("http://") != std::string::npos) {
-    address_ = has_port ? address_.substr(7, pos - 7) : address_.substr(7);
-    if (port_ == 0) {
-      port_ = 80;
-    }
+  if (port_ == -1) {
+    port_ = use_ssl_ ? 443 : 80;
   }
 }
 
 http_client::~http_client() noexcept {
-  if (service_ && !service_->is_global()) {
-    delete service_;
+  if (service_) {
+    if (service_->is_shared()) {
+      service_->detach();
+    } else {
+      delete service_;
+    }
     service_ = nullptr;
   }
 }
@@ -86,29 +125,28 @@ http_response http_client::request(const char* method, std::string path, const s
   req->cci.protocol = "http";
   req->cci.method = method;
 
-  if (port_ == 443) {
+  if (use_ssl_) {
     req->cci.ssl_connection = LCCSCF_USE_SSL;
   }
 
-  auto& http_info = req->http_info;
+  auto& http_info = *req->http_info;
   http_info.request = request;
   http_info.callback = nullptr;
   service_->request(req);
-  while (!http_info.completed.load(std::memory_order_relaxed)) {
+  // the service thread is done with the request once completed is set, it is ours to release
+  while (!http_info.completed.load(std::memory_order_acquire)) {
       std::this_thread::yield();
   }
-  http_response response(http_info.status, http_info.content_type, http_info.response.str());
+  http_response response(http_info.status, http_info.content_type, std::move(http_info.response));
   service_->release_request(req);
   return response;
 }
 
-void http_client::request(const char* method, std::string path, AsyncCallback&& callback) {
+request_info* http_client::make_async_request(const char* method, std::string path) {
   auto req = service_->get_request_info(request_type::http);
   if (!req) {
-    callback(http_response(500, "", "Failed to create lws_context"));
-    return;
+    return nullptr;
   }
-  req->type = request_type::http;
   req->path = std::move(path);
   memset(&req->cci, 0, sizeof(req->cci));
   req->cci.port = port_;
@@ -122,74 +160,91 @@ void http_client::request(const char* method, std::string path, AsyncCallback&&
   req->cci.protocol = "http";
   req->cci.method = method;
 
-  if (port_ == 443) {
+  if (use_ssl_) {
     req->cci.ssl_connection = LCCSCF_USE_SSL;
   }
+  return req;
+}
 
-  auto& http_info = req->http_info;
-  http_info.request = nullptr;
-  http_info.callback = callback;
-  service_->request(req);
+void http_client::request(const char* method, std::string path, AsyncCallback&& callback) {
+  request(method, std::move(path), nullptr, std::move(callback));
 }
 
 void http_client::request(const char *method,
                           std::string path,
                           const std::shared_ptr<http_request>& request,
                           AsyncCallback &&callback) {
-  auto req = service_->get_request_info(request_type::http);
+  auto req = make_async_request(method, std::move(path));
   if (!req) {
     callback(http_response(500, "", "Failed to create lws_context"));
     return;
   }
-  req->path = std::move(path);
-  memset(&req->cci, 0, sizeof(req->cci));
-  req->cci.port = port_;
-  req->cci.address = address_.c_str();
-  req->cci.host = req->cci.address;
-  req->cci.origin = req->cci.address;
-  req->cci.alpn = "http/1.1";
-  req->cci.path = req->path.c_str();
-  req->cci.pwsi = &req->wsi;
-  req->cci.userdata = req;
-  req->cci.protocol = "http";
-  req->cci.method = method;
 
-  if (port_ == 443) {
-    req->cci.ssl_connection = LCCSCF_USE_SSL;
+  auto& http_info = *req->http_info;
+  http_info.request = request;
+  http_info.callback = callback;
+  service_->request(req);
+}
+
+void http_client::request(std::vector<http_async_request>&& requests) {
+  std::vector<request_info*> reqs;
+  reqs.reserve(requests.size());
+  for (auto& r : requests) {
+    auto req = make_async_request(r.method, std::move(r.path));
+    if (!req) {
+      r.callback(http_response(500, "", "Failed to create lws_context"));
+      continue;
+    }
+
+    auto& http_info = *req->http_info;
+    http_info.request = std::move(r.request);
+    http_info.callback = std::move(r.callback);
+    reqs.push_back(req);
+  }
+  service_->request(reqs.data(), reqs.size());
+}
+
+void http_client::request_stream(const char *method,
+                                 std::string path,
+                                 const std::shared_ptr<http_request>& request,
+                                 StreamCallback &&callback) {
+  auto req = make_async_request(method, std::move(path));
+  if (!req) {
+    static const char err[] = "Failed to create lws_context";
+    callback(500, err, sizeof(err) - 1, true);
+    return;
   }
 
-  auto& http_info = req->http_info;
+  auto& http_info = *req->http_info;
   http_info.request = request;
-  http_info.callback = callback;
+  http_info.stream_callback = std::move(callback);
   service_->request(req);
 }
 
 int http_callback(struct lws *wsi, enum lws_callback_reasons reason, void* user, void* in, size_t len) {
   auto req = (request_info*)lws_wsi_user(wsi);
-  if (!req) {
+  if (!req || req->type != request_type::http) {
     return lws_callback_http_dummy(wsi, reason, user, in, len);
   }
-  auto& http_info = req->http_info;
+  auto& http_info = *req->http_info;
 
   switch (reason) {
     case LWS_CALLBACK_CLIENT_CONNECTION_ERROR:
       lwsl_user("%s:%d Connection error occurred. ", req->cci.address, req->cci.port);
-      http_info.response << req->path << " error occurred. ";
+      http_info.response.append(req->path).append(" error occurred. ");
       if (in && len) {
-        http_info.response << std::string((char*)in, len);
+        http_info.response.append((const char*)in, len);
         lwsl_user("%s", (const char*)in);
       }
       lwsl_user("\n");
       req->wsi = nullptr;
-      http_info.completed.store(true, std::memory_order_release);
       break;
 
     case LWS_CALLBACK_CLIENT_APPEND_HANDSHAKE_HEADER: {
       unsigned char **p = (unsigned char **) in, *end = (*p) + len - 1;
       if (lws_add_http_header_by_token(wsi, WSI_TOKEN_HTTP_USER_AGENT, (unsigned char*)"libwebsocket", 12, p, end)) {
         req->wsi = nullptr;
-        http_info.response << req->path << " failed to add User-Agent header";
-        http_info.completed.store(true, std::memory_order_release);
+        http_info.response.append(req->path).append(" failed to add User-Agent header");
         return -1;
       }
 
@@ -206,8 +261,8 @@ int http_callback(struct lws *wsi, enum lws_callback_reasons reason, void* user,
                                           p,
                                           end)) {
             req->wsi = nullptr;
-            http_info.response << req->path << " failed to add header " << kvp.first << ": " << kvp.second;
-            http_info.completed.store(true, std::memory_order_release);
+            http_info.response.append(req->path).append(" failed to add header ")
+                .append(kvp.first).append(" ").append(kvp.second);
             return -1;
           }
         }
@@ -222,16 +277,15 @@ int http_callback(struct lws *wsi, enum lws_callback_reasons reason, void* user,
                                          p,
                                          end)) {
           req->wsi = nullptr;
-          http_info.response << req->path << " failed to add header Content-Type:" << content_type;
-          http_info.completed.store(true, std::memory_order_release);
+          http_info.response.append(req->path).append(" failed to add header Content-Type:").append(content_type);
           return -1;
         }
       }
 
 
-      const auto& body = http_info.request->body();
-      if (!body.empty()) {
-        std::string sz = std::to_string(body.size());
+      auto body_size = http_info.request->body_size();
+      if (body_size) {
+        std::string sz = std::to_string(body_size);
         if (lws_add_http_header_by_token(wsi,
                                          WSI_TOKEN_HTTP_CONTENT_LENGTH,
                                          (unsigned char *) sz.c_str(),
@@ -239,8 +293,7 @@ int http_callback(struct lws *wsi, enum lws_callback_reasons reason, void* user,
                                          p,
                                          end)) {
           req->wsi = nullptr;
-          http_info.response << req->path << " failed to add header Content-Length:" << sz;
-          http_info.completed.store(true, std::memory_order_release);
+          http_info.response.append(req->path).append(" failed to add header Content-Length:").append(sz);
           return -1;
         }
         lws_client_http_body_pending(wsi, 1);
@@ -255,25 +308,48 @@ int http_callback(struct lws *wsi, enum lws_callback_reasons reason, void* user,
 		  break;
 	  }
 
-      const auto& body = http_info.request->body();
-      auto sz = body.size() + 1;
+      // body is sent in buffer sized chunks, one per writeable callback
+      const auto& request = *http_info.request;
+      auto remaining = request.body_size() - http_info.body_sent;
+      size_t n = std::min(remaining, sizeof(http_info.buffer) - LWS_PRE);
 
-      if (sz > sizeof(http_info.buffer) - LWS_PRE) {
-        req->wsi = nullptr;
-        http_info.response << req->path << " body exceeds buffer size";
-        http_info.completed.store(true, std::memory_order_release);
-        return -1;
+      // respect h2 flow control window, -1 means no flow control
+      auto allowance = lws_get_peer_write_allowance(wsi);
+      if (allowance == 0) {
+        lws_callback_on_writable(wsi);
+        break;
+      }
+      if (allowance > 0) {
+        n = std::min(n, (size_t)allowance);
       }
 
-      auto n = lws_snprintf((char*)p, sz, "%s", body.c_str());
-      lws_client_http_body_pending(wsi, 0);
+      if (request.body_fd() != -1) {
+        auto rd = read_fd(request.body_fd(), p, n);
+        if (rd <= 0) {
+          req->wsi = nullptr;
+          http_info.response.append(req->path).append(" failed to read body");
+          return -1;
+        }
+        n = (size_t)rd;
+      } else {
+        memcpy(p, request.body_data() + http_info.body_sent, n);
+      }
+
+      http_info.body_sent += n;
+      bool last = http_info.body_sent == request.body_size();
+      if (last) {
+        lws_client_http_body_pending(wsi, 0);
+      }
 
-      if (lws_write(wsi, p, n, LWS_WRITE_HTTP_FINAL) != n) {
+      if (lws_write(wsi, p, n, last ? LWS_WRITE_HTTP_FINAL : LWS_WRITE_HTTP) != (int)n) {
         req->wsi = nullptr;
-        http_info.response << req->path << " failed to write body";
-        http_info.completed.store(true, std::memory_order_release);
+        http_info.response.append(req->path).append(" failed to write body");
         return -1;
       }
+
+      if (!last) {
+        lws_callback_on_writable(wsi);
+      }
       break;
     }
 
@@ -282,6 +358,16 @@ int http_callback(struct lws *wsi, enum lws_callback_reasons reason, void* user,
       assert(sizeof(http_info.content_type) > (size_t)lws_hdr_total_length(wsi, WSI_TOKEN_HTTP_CONTENT_TYPE));
       lws_hdr_copy(wsi, http_info.content_type, sizeof(http_info.content_type), WSI_TOKEN_HTTP_CONTENT_TYPE);
       http_info.response.clear();
+      if (http_info.stream_callback) {
+        break;
+      }
+
+      // size the response buffer up front so large bodies are not re-allocated while growing
+      char content_length[32];
+      if (lws_hdr_copy(wsi, content_length, sizeof(content_length), WSI_TOKEN_HTTP_CONTENT_LENGTH) > 0) {
+        auto sz = strtoull(content_length, nullptr, 10);
+        http_info.response.reserve(std::min<size_t>(sz, MAX_RESPONSE_RESERVE));
+      }
       break;
     }
 
@@ -289,26 +375,33 @@ int http_callback(struct lws *wsi, enum lws_callback_reasons reason, void* user,
       char *px = http_info.buffer + LWS_PRE;
       auto buffer_len = http_info.buffer_len;
       if (lws_http_client_read(wsi, &px, &buffer_len) < 0) {
-        http_info.completed.store(true, std::memory_order_relaxed);
         return -1;
       }
       return 0;
     }
 
     case LWS_CALLBACK_RECEIVE_CLIENT_HTTP_READ:
-      http_info.response << std::string((char*)in, len);
+      if (http_info.stream_callback) {
+        http_info.stream_callback(http_info.status, (const char*)in, len, false);
+      } else {
+        http_info.response.append((const char*)in, len);
+      }
+      if (req->service->options().http2_stream_window > 0) {
+        // consumed, let peer send more on this stream
+        lws_wsi_tx_credit(wsi, LWSTXCR_PEER_TO_US, (int)len);
+      }
       return 0;
 
     case LWS_CALLBACK_COMPLETED_CLIENT_HTTP:
     case LWS_CALLBACK_CLOSED_CLIENT_HTTP:
+      // a keep-alive connection outlives the request, detach it before request_info is recycled
+      lws_set_wsi_user(wsi, nullptr);
       req->wsi = nullptr;
-      http_info.completed.store(true, std::memory_order_release);
       lws_cancel_service(lws_get_context(wsi));
       break;
 
     case LWS_CALLBACK_WSI_DESTROY:
       req->wsi = nullptr;
-      http_info.completed.store(true, std::memory_order_release);
       break;
 
     default:
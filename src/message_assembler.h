@@ -0,0 +1,109 @@
+/***
+ *  MIT License
+ *
+ *  Copyright (c) 2021 SlickTech <support@slicktech.org>
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ */
+
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace slick {
+namespace net {
+
+/**
+ * Collects the fragments of a WebSocket message so it is delivered once, whole.
+ * The buffer is kept across messages and connections so its capacity is reused.
+ */
+class message_assembler {
+  std::string buffer_;
+  size_t max_size_ = 0;
+  bool delivered_ = false;    // buffer_ holds a message already returned by add()
+  bool dropping_ = false;     // rest of a message found too large, skipped up to its last fragment
+
+ public:
+  enum class result : uint8_t {
+    partial,      // more fragments to come
+    complete,     // data and size hold the whole message until the next add()
+    too_large,    // the message exceeds max_size, it is dropped up to its last fragment
+    dropped,      // fragment of a message found too large before
+  };
+
+  /**
+   * Largest whole message in bytes. 0 is unlimited.
+   */
+  void set_max_size(size_t max_size) noexcept { max_size_ = max_size; }
+  size_t max_size() const noexcept { return max_size_; }
+
+  /**
+   * Add the next fragment of the message
+   * @param in      Fragment
+   * @param len     Fragment length
+   * @param last    True if the fragment completes the message
+   * @param data    Set to the whole message when complete. A message arriving in one piece
+   *                points to in, it is not copied.
+   * @param size    Set to the message length when complete
+   */
+  result add(const char* in, size_t len, bool last, const char*& data, size_t& size) {
+    if (delivered_) {
+      buffer_.clear();
+      delivered_ = false;
+    }
+    if (dropping_) {
+      dropping_ = !last;
+      return result::dropped;
+    }
+    if (max_size_ && buffer_.size() + len > max_size_) {
+      buffer_.clear();
+      dropping_ = !last;
+      return result::too_large;
+    }
+    if (last && buffer_.empty()) {
+      data = in;
+      size = len;
+      return result::complete;
+    }
+
+    buffer_.append(in, len);
+    if (!last) {
+      return result::partial;
+    }
+    data = buffer_.data();
+    size = buffer_.size();
+    delivered_ = true;
+    return result::complete;
+  }
+
+  /**
+   * Drop the fragments collected so far, e.g. when the connection is replaced
+   */
+  void clear() noexcept {
+    buffer_.clear();
+    delivered_ = false;
+    dropping_ = false;
+  }
+};
+
+}
+}
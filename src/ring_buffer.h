@@ -31,6 +31,19 @@
 #include <cstring>
 #include <algorithm>
 #include <vector>
+#include <mutex>
+#include <new>
+#include <memory>
+#include <chrono>
+#include <functional>
+#include <slicksocket/service_options.h>
+
+// Producer and consumer owned state is kept on separate cache lines to avoid false sharing.
+// Aligned members also round the object size up to whole lines, so neighbours don't share them either.
+// Build with -DSLICK_CACHE_LINE_SIZE=128 on CPUs that prefetch adjacent lines in pairs.
+#ifndef SLICK_CACHE_LINE_SIZE
+#define SLICK_CACHE_LINE_SIZE 64
+#endif
 
 namespace slick {
 namespace net {
@@ -98,7 +111,7 @@ class ring_buffer {
     return const_cast<T&>((*static_cast<const ring_buffer<T>*>(this))[index]);
   }
 
-  size_t available() const noexcept { return cursor_.load(std::memory_order_relaxed); }
+  size_t available() const noexcept { return cursor_.load(std::memory_order_acquire); }
 
   slot reserve(size_t num = 1) noexcept {
     return slot(this, reserved_.fetch_add(num, std::memory_order_acq_rel), num);
@@ -114,17 +127,21 @@ class ring_buffer {
     assert(size && !(size & size -1));
   }
 
+  /**
+   * Slots are published in reservation order. Only the producer whose turn it is writes the cursor,
+   * so a plain release store is enough. The acquire load carries earlier producers' slots along.
+   */
   void publish(size_t index, size_t num) noexcept {
-    while(cursor_.load(std::memory_order_relaxed) != index) { std::this_thread::yield(); }
-    cursor_.fetch_add(num);
+    while(cursor_.load(std::memory_order_acquire) != index) { std::this_thread::yield(); }
+    cursor_.store(index + num, std::memory_order_release);
   }
 
  protected:
   T* buffer_ = nullptr;
   const size_t size_;
   const size_t mask_;
-  std::atomic<size_t> cursor_ {0};
-  std::atomic<size_t> reserved_ {0};
+  alignas(SLICK_CACHE_LINE_SIZE) std::atomic<size_t> cursor_ {0};     // written by producers, polled by consumer
+  alignas(SLICK_CACHE_LINE_SIZE) std::atomic<size_t> reserved_ {0};   // producers only
 };
 
 class scoped_flag final {
@@ -135,24 +152,53 @@ class scoped_flag final {
   std::atomic_bool& flag_;
 };
 
+/**
+ * Ring of variable length messages. Any number of producers, one consumer.
+ * Producers claim space with a CAS and publish in claim order.
+ */
 class ring_string_buffer {
  private:
   enum class flag : uint8_t {
     OK = 0,
     INVALID,
     SKIP,
+    SPILL,    // message too large for the ring, content lives in a heap buffer
+    PAD,      // one byte filler left by a commit shorter than its reservation
+  };
+
+  struct spill_entry {
+    char* data;
+    size_t len;
   };
  public:
+  // flag (1 byte) + tag (1 byte) + len (4 bytes)
+  static constexpr size_t HEADER_SIZE = 6;
+  static constexpr size_t NONE = ~size_t(0);
+
+  // invoked with true when queued bytes reach the high watermark, false when they drop to the low watermark
+  using watermark_callback = std::function<void(bool, size_t)>;
+
+  /**
+   * Space claimed by reserve(), owned by the producer until commit()
+   */
+  struct reservation {
+    char* data = nullptr;       // content, right after the headroom
+    size_t begin = 0;           // position of the message header
+    size_t end = 0;             // position after the claimed space
+    size_t headroom = 0;
+    size_t capacity = 0;        // max content length
+    char* spill = nullptr;      // heap buffer of a spilled message
+  };
+
   ring_string_buffer(size_t size)
-      : buffer_(new char[size])
-      , size_(size)
-      , mask_(size - 1)
-	  , writing_{false}
+      : size_(_round_capacity(size))
+      , mask_(size_ - 1)
   {
-    assert(size && !(size & mask_));
+    buffer_ = new char[size_];
   }
 
   ~ring_string_buffer() {
+    _release_spilled();
     delete[] buffer_;
 	buffer_ = nullptr;
   }
@@ -162,188 +208,460 @@ class ring_string_buffer {
   ring_string_buffer& operator=(const ring_string_buffer&) = delete;
   ring_string_buffer& operator=(ring_string_buffer&&) = delete;
 
+  /**
+   * Set what producers do when the buffer is full and the watermarks to report.
+   * Must be called before writing.
+   */
+  void configure(const send_buffer_options& options, watermark_callback on_watermark = nullptr) {
+    options_ = options;
+    on_watermark_ = std::move(on_watermark);
+  }
+
+  /**
+   * Change the capacity, rounded up to a power of 2. Queued messages are dropped.
+   * Only call while no other thread is using the buffer.
+   */
+  void resize(size_t size) {
+    auto capacity = _round_capacity(size);
+    if (capacity == size_) {
+      return;
+    }
 
-  bool write(const char* const msg, size_t len, size_t remaining = 0) {
-    if (resetting_.load(std::memory_order_relaxed) || len == 0) {
+    reset();
+    delete[] buffer_;
+    buffer_ = new char[capacity];
+    size_ = capacity;
+    mask_ = capacity - 1;
+  }
+
+  size_t capacity() const noexcept { return size_; }
+
+  /**
+   * Number of bytes, headers included, written but not read yet.
+   */
+  size_t queued() const noexcept {
+    return cursor_.load(std::memory_order_relaxed) - _released();
+  }
+
+  /**
+   * True if every published message has been read
+   */
+  bool empty() const noexcept {
+    return reading_begin_.load(std::memory_order_relaxed) == cursor_.load(std::memory_order_acquire);
+  }
+
+  /**
+   * Write a message
+   * @param msg         Message content
+   * @param len         Content length
+   * @param tag         User defined byte stored with the message
+   * @return            False if the message can't be written.
+   */
+  bool write(const char* const msg, size_t len, uint8_t tag = 0) {
+    reservation r;
+    auto buf = reserve(r, len, 0, tag);
+    if (!buf) {
       return false;
     }
+    memcpy(buf, msg, len);
+    commit(r, len);
+    return true;
+  }
 
-    scoped_flag sf(writing_);
-    uint32_t reset_count = reset_count_;
+  /**
+   * Reserve contiguous space for a message so it can be serialized in place.
+   * Messages reserved concurrently are read in reservation order, so commit() promptly.
+   * @param r           Receives the reservation, pass it to commit()
+   * @param len         Maximum content length
+   * @param headroom    Bytes reserved in front of the content, returned to the reader as part of the message
+   * @param tag         User defined byte stored with the message
+   * @return            Pointer to the content, right after the headroom. nullptr if space can't be reserved.
+   */
+  char* reserve(reservation& r, size_t len, size_t headroom = 0, uint8_t tag = 0) {
+    if (len == 0) {
+      return nullptr;
+    }
 
-    // message format
-    // <-- flag (1 byte) --><-- len (4 bytes) --><-- content -->
+    // pairs with reset(), either reset sees the writer or the writer sees resetting_
+    writers_.fetch_add(1, std::memory_order_seq_cst);
+    if (resetting_.load(std::memory_order_seq_cst)) {
+      writers_.fetch_sub(1, std::memory_order_release);
+      return nullptr;
+    }
 
-    if (writing_cursor_ == 0) {  // write a new string
-      total_ = len + remaining + 5;
-      remaining_ = len + remaining;
-      if (total_ >= size_) {
-        writing_cursor_ = 1;
-        remaining_ -= len;
-        skip_ = true;
-        assert(false);
-        return false;
+    r.headroom = headroom;
+    r.capacity = len;
+    r.spill = nullptr;
+    size_t total = len + headroom + HEADER_SIZE;
+    if (total >= size_) {
+      // message too large for the ring, queue a SPILL entry pointing to a heap buffer
+      r.spill = new (std::nothrow) char[len + headroom];
+      if (!r.spill) {
+        writers_.fetch_sub(1, std::memory_order_release);
+        return nullptr;
       }
+      total = HEADER_SIZE + sizeof(spill_entry);
+    }
+
+    if (!_claim(r, total)) {
+      delete[] r.spill;
+      r.spill = nullptr;
+      writers_.fetch_sub(1, std::memory_order_release);
+      return nullptr;
+    }
 
-      writing_begin_ = writing_cursor_ = reserved_.fetch_add(total_);
-      auto index = writing_begin_ & mask_;
-      if ((index + total_) >= size_) {
-        // remaining buffer is not enough to hold the string
-        // set flag to SKIP and start from the beginning
-        auto padding_sz = size_ - index;
-        reserved_.fetch_add(padding_sz);
-
-        *reinterpret_cast<flag*>(&buffer_[writing_cursor_ & mask_]) = flag::SKIP;
-        _notify(padding_sz);
-        writing_cursor_ = writing_begin_;
+    *reinterpret_cast<flag*>(&buffer_[r.begin & mask_]) = r.spill ? flag::SPILL : flag::OK;
+    *reinterpret_cast<uint8_t*>(&buffer_[(r.begin + 1) & mask_]) = tag;
+    *reinterpret_cast<uint32_t*>(&buffer_[(r.begin + 2) & mask_]) = (uint32_t)(total - HEADER_SIZE);
+
+    r.data = r.spill ? r.spill + headroom : &buffer_[(r.begin + HEADER_SIZE + headroom) & mask_];
+    return r.data;
+  }
+
+  /**
+   * Publish a reserved message.
+   * @param r       Reservation returned by reserve()
+   * @param len     Actual content length, no more than reserved. 0 discards the message.
+   */
+  void commit(reservation& r, size_t len) {
+    assert(r.data && len <= r.capacity);
+
+    auto header = &buffer_[r.begin & mask_];
+    if (len == 0) {
+      *reinterpret_cast<flag*>(header) = flag::INVALID;
+      delete[] r.spill;
+    } else if (r.spill) {
+      spill_entry spilled {r.spill, r.headroom + len};
+      memcpy(&buffer_[(r.begin + HEADER_SIZE) & mask_], &spilled, sizeof(spilled));
+    } else if (len < r.capacity) {
+      // leave the unused tail to the reader as filler
+      auto content_end = r.begin + HEADER_SIZE + r.headroom + len;
+      auto gap = r.end - content_end;
+      *reinterpret_cast<uint32_t*>(header + 2) = (uint32_t)(r.headroom + len);
+      if (gap >= HEADER_SIZE) {
+        *reinterpret_cast<flag*>(&buffer_[content_end & mask_]) = flag::INVALID;
+        *reinterpret_cast<uint32_t*>(&buffer_[(content_end + 2) & mask_]) = (uint32_t)(gap - HEADER_SIZE);
+      } else {
+        memset(&buffer_[content_end & mask_], (int)flag::PAD, gap);
       }
+    }
 
-      auto begin = writing_cursor_ & mask_;
-      auto end = (writing_cursor_ + total_) & mask_;
-      uint32_t i = 1;
-      while(!resetting_.load(std::memory_order_relaxed) &&
-          begin < reading_begin_.load(std::memory_order_relaxed) &&
-          end > reading_begin_.load(std::memory_order_relaxed)) {
-        // write and read overlap, wait for reading cursor advance
-        if ((i++% 50) == 0) {
-          printf("Slow consumer. begin=%zu, end=%zu, read_index=%zu, retry_count=%d\n",
-                 begin,
-                 end,
-                 reading_begin_.load(std::memory_order_relaxed),
-                 i);
-        }
-        std::this_thread::yield();
+    _publish(r.begin, r.end);
+    r.data = nullptr;
+    writers_.fetch_sub(1, std::memory_order_release);
+    _check_high();
+  }
+
+  /**
+   * Read next message. Single consumer only.
+   * The message stays valid until the next read() or read_into().
+   * @param tag     If not null, receives the tag written with the message
+   * @return        Message content and length. nullptr if no message available.
+   */
+  std::pair<const char*, size_t> read(uint8_t* tag = nullptr) noexcept {
+    // release the message returned last time
+    holding_.store(NONE, std::memory_order_release);
+    auto begin = reading_begin_.load(std::memory_order_acquire);
+    while (!resetting_.load(std::memory_order_relaxed) && begin != cursor_.load(std::memory_order_acquire)) {
+      auto flg = *reinterpret_cast<flag*>(&buffer_[begin & mask_]);
+      // SKIP and PAD may be a single byte, the next one belongs to the following entry
+      auto has_header = flg != flag::SKIP && flg != flag::PAD;
+      auto tg = has_header ? *reinterpret_cast<uint8_t*>(&buffer_[(begin + 1) & mask_]) : 0;
+      auto next = _next(begin);
+      spill_entry spilled {nullptr, 0};
+      if (flg == flag::SPILL) {
+        memcpy(&spilled, &buffer_[(begin + HEADER_SIZE) & mask_], sizeof(spilled));
+      }
+      // hold the space before claiming so producers don't reuse it while the caller reads,
+      // pairs with _released()
+      holding_.store(begin, std::memory_order_seq_cst);
+      // a producer may drop the message under us, see overflow_policy::drop_oldest
+      if (!reading_begin_.compare_exchange_strong(begin, next, std::memory_order_seq_cst)) {
+        continue;
       }
 
-      if (reset_count != reset_count_) {
-        // buffer reset, bail out
-        writing_cursor_ = 0;
-        skip_ = false;
-        return false;
+      if (tag) {
+        *tag = tg;
+      }
+      if (flg == flag::OK) {
+        _check_low();
+        return std::make_pair(&buffer_[(begin + HEADER_SIZE) & mask_], next - begin - HEADER_SIZE);
       }
 
-      *reinterpret_cast<flag*>(&buffer_[writing_cursor_++ & mask_]) = flag::OK;
-      *reinterpret_cast<uint32_t*>(&buffer_[writing_cursor_ & mask_]) = (uint32_t)total_ - 5;
-      writing_cursor_ += 4;
+      holding_.store(NONE, std::memory_order_release);
+      _check_low();
+      if (flg == flag::SPILL) {
+        // kept until the next read so the caller can use it
+        spilled_.reset(spilled.data);
+        return std::make_pair(spilled.data, spilled.len);
+      }
+      begin = next;
     }
+    holding_.store(NONE, std::memory_order_release);
+    return std::make_pair(nullptr, 0);
+  }
 
-    remaining_ -= len;
-    assert(remaining_ == remaining);
+  /**
+   * Copy consecutive messages into dest and consume them, as many as fit whole. Single consumer only.
+   * @param dest        Destination buffer
+   * @param capacity    Size of dest
+   * @return            Bytes copied. 0 if no message available or the next one is larger than capacity
+   *                    or spilled, read() it instead.
+   */
+  size_t read_into(char* dest, size_t capacity) noexcept {
+    holding_.store(NONE, std::memory_order_release);
+    auto cursor = cursor_.load(std::memory_order_acquire);
+    auto begin = reading_begin_.load(std::memory_order_acquire);
+    auto rc = begin;
+    size_t copied = 0;
+    while (!resetting_.load(std::memory_order_relaxed) && rc != cursor) {
+      auto flg = *reinterpret_cast<flag*>(&buffer_[rc & mask_]);
+      if (flg == flag::SPILL) {
+        break;
+      }
+      auto next = _next(rc);
+      if (flg == flag::OK) {
+        auto len = next - rc - HEADER_SIZE;
+        if (copied + len > capacity) {
+          break;
+        }
+        memcpy(dest + copied, &buffer_[(rc + HEADER_SIZE) & mask_], len);
+        copied += len;
+      }
+      rc = next;
+    }
 
-    if (remaining_ == remaining && !skip_) {
-      memcpy(&buffer_[writing_cursor_ & mask_], msg, len);
-      writing_cursor_ += len;
+    if (rc != begin) {
+      // release the space only after the messages were copied out.
+      // If a producer dropped any of them meanwhile the copy may be torn, start over.
+      if (!reading_begin_.compare_exchange_strong(begin, rc, std::memory_order_acq_rel)) {
+        return read_into(dest, capacity);
+      }
+      _check_low();
     }
+    return copied;
+  }
 
-    if (remaining == 0) {
-      if (!skip_) {
-        if (remaining_ != remaining) {
-          printf("message messed up, mark buffer invalid. begin=%zu", writing_begin_);
-          *reinterpret_cast<flag*>(&buffer_[writing_begin_ & mask_]) = flag::INVALID;
+  /**
+   * Drop all queued messages. Waits for reservations in progress to be committed.
+   */
+  void reset() noexcept {
+    scoped_flag sf(resetting_);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    while (writers_.load(std::memory_order_acquire)); // wait for writing complete;
+    _release_spilled();
+    reserved_.store(0, std::memory_order_relaxed);
+    cursor_.store(0, std::memory_order_relaxed);
+    above_high_.store(false, std::memory_order_relaxed);
+    holding_.store(NONE, std::memory_order_relaxed);
+    reading_begin_.store(0, std::memory_order_release);
+  }
+
+ private:
+  static size_t _round_capacity(size_t size) noexcept {
+    size_t capacity = 64;
+    while (capacity < size) {
+      capacity <<= 1;
+    }
+    return capacity;
+  }
+
+  // claim total contiguous bytes. If they would wrap, the tail of the ring is claimed
+  // and published as SKIP padding first, so the message only ever needs total free bytes.
+  bool _claim(reservation& r, size_t total) {
+    auto start = reserved_.load(std::memory_order_relaxed);
+    while (true) {
+      auto index = start & mask_;
+      auto wrap = index + total > size_;
+      auto end = wrap ? start + size_ - index : start + total;
+      if (end > _released() + size_) {
+        if (!_make_space(end)) {
+          return false;
         }
-        _notify(total_);
+        start = reserved_.load(std::memory_order_relaxed);
+        continue;
+      }
+
+      if (!reserved_.compare_exchange_weak(start, end, std::memory_order_acq_rel)) {
+        continue;
+      }
+
+      if (wrap) {
+        *reinterpret_cast<flag*>(&buffer_[index]) = flag::SKIP;
+        _publish(start, end);
+        // if the reader is at the padding, move it past so the space is free right away.
+        // Races with read() like overflow_policy::drop_oldest, whoever wins the CAS skips it.
+        auto at = start;
+        reading_begin_.compare_exchange_strong(at, end, std::memory_order_acq_rel);
+        start = end;
+        continue;
       }
-      // string completed
-      writing_cursor_ = 0;
-      skip_ = false;
+
+      r.begin = start;
+      r.end = end;
+      return true;
     }
-    return true;
   }
 
-  std::pair<const char*, size_t> read() noexcept {
-    auto cursor = cursor_.load(std::memory_order_relaxed);
-    if (!resetting_.load(std::memory_order_relaxed)
-        && reading_begin_.load(std::memory_order_relaxed) != (cursor & mask_)) {
-      auto flg = *reinterpret_cast<flag*>(&buffer_[reading_cursor_++ & mask_]);
-      switch (flg) {
-        case flag::SKIP: {
-          auto index = reading_cursor_ & mask_;
-          reading_cursor_ += index ? size_ - index : 0;
-          reading_begin_.store(reading_cursor_ & mask_, std::memory_order_release);
-          return std::make_pair(nullptr, 0);
+  // publish [start, end) in claim order
+  void _publish(size_t start, size_t end) {
+    while (cursor_.load(std::memory_order_acquire) != start) { std::this_thread::yield(); }
+    cursor_.store(end, std::memory_order_release);
+  }
+
+  // wait until the reader has released everything before end, as the overflow policy allows
+  bool _make_space(size_t end) {
+    auto full = [this, end]() {
+      // end may be stale and already behind the reader
+      return end > _released() + size_;
+    };
+
+    switch (options_.overflow) {
+      case overflow_policy::fail:
+        return false;
+
+      case overflow_policy::drop_oldest:
+        while (!resetting_.load(std::memory_order_relaxed) && full()) {
+          auto begin = reading_begin_.load(std::memory_order_acquire);
+          if (end <= begin + size_ || begin == cursor_.load(std::memory_order_acquire)) {
+            // enough unread messages are gone, the rest is the message the reader holds
+            // or other producers' reservations. Wait for them rather than drop more.
+            std::this_thread::yield();
+          } else if (reading_begin_.compare_exchange_strong(begin, _next(begin), std::memory_order_acq_rel)) {
+            _free_spill(begin);
+          }
         }
-        case flag::INVALID: {
-          auto len = *reinterpret_cast<uint32_t*>(&buffer_[reading_cursor_ & mask_]);
-          reading_cursor_ += len + 4;
-          reading_begin_.store(reading_cursor_ & mask_, std::memory_order_release);
-          return std::make_pair(nullptr, 0);
+        break;
+
+      case overflow_policy::block:
+      case overflow_policy::block_with_timeout: {
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::microseconds(options_.block_timeout_us);
+        while (!resetting_.load(std::memory_order_relaxed) && full()) {
+          if (options_.overflow == overflow_policy::block_with_timeout
+              && std::chrono::steady_clock::now() >= deadline) {
+            return false;
+          }
+          std::this_thread::yield();
         }
-        case flag::OK:
-          break;
+        break;
       }
+    }
+    return !resetting_.load(std::memory_order_relaxed);
+  }
 
-      auto len = *reinterpret_cast<uint32_t*>(&buffer_[reading_cursor_ & mask_]);
-      auto cur = reading_cursor_ + 4;
-      reading_cursor_ += len + 4;
-      const char* str = &buffer_[cur & mask_];
-      reading_begin_.store(reading_cursor_ & mask_, std::memory_order_release);
-      return std::make_pair(str, len);
+  // space before this position can be reused by producers
+  size_t _released() const noexcept {
+    auto begin = reading_begin_.load(std::memory_order_seq_cst);
+    auto holding = holding_.load(std::memory_order_seq_cst);
+    return holding != NONE && holding < begin ? holding : begin;
+  }
+
+  // position of the message following the one at pos
+  size_t _next(size_t pos) const noexcept {
+    switch (*reinterpret_cast<flag*>(&buffer_[pos & mask_])) {
+      case flag::SKIP:
+        return pos + size_ - (pos & mask_);
+      case flag::PAD:
+        return pos + 1;
+      default:
+        return pos + HEADER_SIZE + *reinterpret_cast<uint32_t*>(&buffer_[(pos + 2) & mask_]);
     }
-    return std::make_pair(nullptr, 0);
   }
 
-  void reset() noexcept {
-    ++reset_count_;
-    scoped_flag sf(resetting_);
-    while (writing_.load(std::memory_order_relaxed)); // wait for writing complete;
-    reserved_.store(0, std::memory_order_relaxed);
-    cursor_.store(0, std::memory_order_relaxed);
-    reading_cursor_ = cursor_.load(std::memory_order_relaxed);
-    writing_begin_ = 0;
-    writing_cursor_ = 0;
-    reading_begin_.store(reading_cursor_ & mask_, std::memory_order_release);
+  // free heap buffers of spilled messages not read yet
+  void _release_spilled() {
+    auto cursor = cursor_.load(std::memory_order_acquire);
+    for (auto pos = reading_begin_.load(std::memory_order_acquire); pos != cursor; pos = _next(pos)) {
+      _free_spill(pos);
+    }
+    spilled_.reset();
   }
 
- private:
-  void _notify(size_t num) {
-    while(cursor_.load(std::memory_order_relaxed) != writing_begin_) { std::this_thread::yield(); }
-    cursor_.fetch_add(num);
-    writing_begin_ += num;
+  void _free_spill(size_t pos) {
+    if (*reinterpret_cast<flag*>(&buffer_[pos & mask_]) == flag::SPILL) {
+      spill_entry spilled;
+      memcpy(&spilled, &buffer_[(pos + HEADER_SIZE) & mask_], sizeof(spilled));
+      delete[] spilled.data;
+    }
   }
 
- private:
-  char* buffer_;
-  const size_t size_;
-  const size_t mask_;
+  void _check_high() {
+    if (options_.high_watermark && queued() >= options_.high_watermark
+        && !above_high_.exchange(true, std::memory_order_acq_rel) && on_watermark_) {
+      on_watermark_(true, queued());
+    }
+  }
 
-  size_t writing_cursor_ {0};
-  size_t writing_begin_ {0};
-  size_t reading_cursor_ {0};
-  size_t total_ {0};
-  size_t remaining_ {0};
-  uint32_t reset_count_ {0};
-  bool skip_ { false };
-  std::atomic<size_t> cursor_ {0};
-  std::atomic<size_t> reserved_ {0};
-  std::atomic<size_t> reading_begin_ {0};
-  std::atomic_bool writing_ {false};
+  void _check_low() {
+    if (above_high_.load(std::memory_order_relaxed) && queued() <= options_.low_watermark
+        && above_high_.exchange(false, std::memory_order_acq_rel) && on_watermark_) {
+      on_watermark_(false, queued());
+    }
+  }
+
+ private:
+  // read mostly
+  char* buffer_ = nullptr;
+  size_t size_;
+  size_t mask_;
+  send_buffer_options options_;
+  watermark_callback on_watermark_;
   std::atomic_bool resetting_ {false};
+  std::atomic_bool above_high_ {false};
+
+  // producers
+  alignas(SLICK_CACHE_LINE_SIZE) std::atomic<size_t> reserved_ {0};   // end of claimed space
+  std::atomic<uint32_t> writers_ {0};       // reservations not committed yet
+
+  // written by producers, polled by consumer
+  alignas(SLICK_CACHE_LINE_SIZE) std::atomic<size_t> cursor_ {0};     // end of published messages
+
+  // written by consumer, checked by producers for free space
+  alignas(SLICK_CACHE_LINE_SIZE) std::atomic<size_t> reading_begin_ {0};   // position of the oldest unread message, never masked
+  std::atomic<size_t> holding_ {NONE};      // position of the message last returned by read(), still in use
+  std::unique_ptr<char[]> spilled_;         // spilled message last returned by read()
 };
 
+class spin_lock final {
+  std::atomic_flag flag_ = ATOMIC_FLAG_INIT;
+ public:
+  spin_lock() = default;
+  ~spin_lock() = default;
+
+  void lock() { while (flag_.test_and_set(std::memory_order_acquire)); }
+  void unlock() { flag_.clear(std::memory_order_release); }
+};
+
+/**
+ * Pool of reusable objects.
+ * Objects are allocated on demand and up to capacity released objects are kept for reuse.
+ */
 template<typename T>
 class object_pool final {
-  T* data_;
-  T* end_;
-  std::vector<size_t> index_;
-  std::atomic_size_t read_cursor_ {0};
-  std::atomic_size_t write_cursor_ {0};
-  const size_t size_;
-  const size_t mask_;
+  // lock and free list are touched together, keep them off neighbouring objects' lines
+  alignas(SLICK_CACHE_LINE_SIZE) spin_lock lock_;
+  std::vector<T*> free_;
+  const size_t capacity_;
 
  public:
-  object_pool(size_t size)
-    : data_(new T[size])
-    , end_(data_ + size)
-    , index_(size)
-    , size_(size)
-    , mask_(size - 1) {
-    assert(size && !(size & (size - 1))); // must power of 2
-    std::generate(index_.begin(), index_.end(), [n = 0]() mutable { return n++; });
+  /**
+   * @param capacity    Max number of released objects kept for reuse
+   * @param reserve     Number of objects allocated up front
+   */
+  object_pool(size_t capacity, size_t reserve = 0)
+    : capacity_(capacity) {
+    free_.reserve(capacity_);
+    reserve = std::min(reserve, capacity_);
+    for (size_t i = 0; i < reserve; ++i) {
+      free_.push_back(new T);
+    }
   }
 
   ~object_pool() {
-    delete [] data_;
-    data_ = nullptr;
+    for (auto obj : free_) {
+      delete obj;
+    }
+    free_.clear();
   }
 
   object_pool(const object_pool&) = delete;
@@ -351,30 +669,29 @@ class object_pool final {
   object_pool& operator=(const object_pool&) = delete;
   object_pool& operator=(object_pool&&) = delete;
 
-  size_t size() const noexcept { return size_; }
+  size_t capacity() const noexcept { return capacity_; }
 
   T* get_obj() noexcept {
-    if (read_cursor_.load(std::memory_order_relaxed) < mask_) {
-      auto i = read_cursor_.fetch_add(1, std::memory_order_acq_rel);
-      if (i < size_ || (i & mask_) < (write_cursor_.load(std::memory_order_relaxed) & mask_)) {
-        return data_ + index_[i & mask_];
+    {
+      std::lock_guard<spin_lock> g(lock_);
+      if (!free_.empty()) {
+        auto obj = free_.back();
+        free_.pop_back();
+        return obj;
       }
-      read_cursor_.fetch_sub(1, std::memory_order_acq_rel);
     }
-
-    // all object pre-allocated are consumed, allocated on the heap
     return new (std::nothrow) T;
   }
 
   void release_obj(T* obj) noexcept {
-    if (obj >= data_ && obj < end_) {
-      // this is pre-allocated object
-      auto index = obj - data_;
-      auto target = write_cursor_.fetch_add(1, std::memory_order_acq_rel);
-      index_[target & mask_] = index;
-      return;
+    {
+      std::lock_guard<spin_lock> g(lock_);
+      if (free_.size() < capacity_) {
+        free_.push_back(obj);
+        return;
+      }
     }
-    // delete object allocated on the heap
+    // pool is full
     delete obj;
   }
 };
@@ -0,0 +1,104 @@
+/***
+ *  MIT License
+ *
+ *  Copyright (c) 2021 SlickTech <support@slicktech.org>
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ */
+
+#include "slicksocket/service_group.h"
+#include "socket_service.h"
+#include <algorithm>
+
+using namespace slick::net;
+
+service_group::service_group(size_t num_services,
+                             shard_policy policy,
+                             const std::string& ca_file_path,
+                             const std::vector<int32_t>& cpu_affinities,
+                             const service_options& options)
+  : policy_(policy) {
+  // clients dereference the assigned service, there must always be one
+  num_services = std::max<size_t>(num_services, 1);
+  services_.reserve(num_services);
+  for (size_t i = 0; i < num_services; ++i) {
+    auto cpu_affinity = i < cpu_affinities.size() ? cpu_affinities[i] : -1;
+    auto service = new socket_service(ca_file_path, cpu_affinity, false, options);
+    service->shared_ = true;
+    services_.push_back(service);
+  }
+}
+
+service_group::service_group(size_t num_services,
+                             shard_selector selector,
+                             const std::string& ca_file_path,
+                             const std::vector<int32_t>& cpu_affinities,
+                             const service_options& options)
+  : service_group(num_services, shard_policy::round_robin, ca_file_path, cpu_affinities, options) {
+  selector_ = std::move(selector);
+}
+
+service_group::~service_group() noexcept {
+  for (auto service : services_) {
+    delete service;
+  }
+  services_.clear();
+}
+
+std::vector<uint32_t> service_group::loads() const {
+  std::vector<uint32_t> loads;
+  loads.reserve(services_.size());
+  for (auto service : services_) {
+    loads.push_back(service->clients());
+  }
+  return loads;
+}
+
+socket_service* service_group::assign(uint64_t shard_key) noexcept {
+  size_t index = 0;
+  if (selector_) {
+    index = selector_(shard_key, loads());
+  } else {
+    switch (policy_) {
+      case shard_policy::round_robin:
+        index = next_.fetch_add(1, std::memory_order_relaxed);
+        break;
+
+      case shard_policy::least_loaded: {
+        uint32_t min_load = UINT32_MAX;
+        for (size_t i = 0; i < services_.size(); ++i) {
+          auto load = services_[i]->clients();
+          if (load < min_load) {
+            min_load = load;
+            index = i;
+          }
+        }
+        break;
+      }
+
+      case shard_policy::shard_key:
+        index = shard_key;
+        break;
+    }
+  }
+
+  auto service = services_[index % services_.size()];
+  service->attach();
+  return service;
+}
@@ -24,28 +24,62 @@
 
 #include "slicksocket/socket_client.h"
 #include "slicksocket/callback.h"
+#include "slicksocket/service_group.h"
 #include "socket_service.h"
 
 using namespace slick::net;
 
+namespace {
+}
+
 socket_client::socket_client(client_callback_t *callback,
                              std::string address,
                              uint32_t port,
                              int32_t cpu_affinity,
-                             bool use_global_thread)
-  : service_(use_global_thread
-             ? socket_service::global("", cpu_affinity)
-             : new socket_service("", cpu_affinity))
-  , address_(std::move(address))
+                             bool use_global_thread,
+                             const service_options& options)
+  : socket_client(callback,
+                  std::move(address),
+                  port,
+                  use_global_thread
+                      ? socket_service::global("", cpu_affinity, options)
+                      : new socket_service("", cpu_affinity, false, options))
+{
+  send_buffer_ = options.send_buffer;
+  reconnect_ = options.reconnect;
+}
+
+socket_client::socket_client(client_callback_t *callback,
+                             std::string address,
+                             uint32_t port,
+                             service_group& group,
+                             uint64_t shard_key)
+  : socket_client(callback, std::move(address), port, group.assign(shard_key))
+{
+}
+
+socket_client::socket_client(client_callback_t *callback,
+                             std::string address,
+                             uint32_t port,
+                             socket_service* service)
+  : callback_(callback)
+  , service_(service)
   , port_(port)
-  , callback_(callback)
+  , address_(std::move(address))
+  , send_buffer_(service->options().send_buffer)
+  , reconnect_(service->options().reconnect)
+  , subscriptions_(std::make_shared<subscription_list>())
 {
 }
 
 socket_client::~socket_client() {
   stop();
-  if (service_ && !service_->is_global()) {
-    delete service_;
+  if (service_) {
+    if (service_->is_shared()) {
+      service_->detach();
+    } else {
+      delete service_;
+    }
     service_ = nullptr;
   }
 }
@@ -69,33 +103,95 @@ bool socket_client::connect() {
   request_->cci.pwsi = &request_->wsi;
   request_->cci.method = "RAW";
   request_->cci.userdata = request_;
-  request_->socket_info.callback = callback_;
-  request_->socket_info.sending_buffer.reset();
-  request_->socket_info.shutdown.store(false, std::memory_order_relaxed);
+  request_->socket_info->callback = callback_;
+  request_->socket_info->sending_buffer.resize(send_buffer_.size);
+  request_->socket_info->sending_buffer.reset();
+  request_->socket_info->sending_buffer.configure(send_buffer_, [cb = callback_](bool high, size_t queued) {
+    if (high) {
+      cb->on_send_buffer_high(queued);
+    } else {
+      cb->on_send_buffer_low(queued);
+    }
+  });
+  request_->socket_info->shutdown.store(false, std::memory_order_relaxed);
+  request_->socket_info->write_pending.store(false, std::memory_order_relaxed);
+  request_->socket_info->subscriptions = subscriptions_;
+  request_->socket_info->reconnect = reconnect_;
+  request_->socket_info->reconnect_attempts = 0;
+  request_->socket_info->reconnect_scheduled = false;
+  request_->socket_info->resolved_address.clear();
   service_->request(request_);
   return true;
 }
 
 void socket_client::stop() noexcept {
   if (request_) {
-    request_->socket_info.shutdown.store(true, std::memory_order_relaxed);
+    request_->socket_info->shutdown.store(true, std::memory_order_relaxed);
     request_ = nullptr;
   }
 }
 
+void socket_client::add_subscription(const char* msg, size_t len) {
+  std::lock_guard<spin_lock> g(subscriptions_->lock);
+  subscriptions_->messages.emplace_back(std::string(msg, len), 0);
+}
+
+void socket_client::clear_subscriptions() noexcept {
+  std::lock_guard<spin_lock> g(subscriptions_->lock);
+  subscriptions_->messages.clear();
+}
+
 bool socket_client::send(char *msg, size_t len) {
   if (!request_ || !request_->wsi) {
     return false;
   }
 
-  auto& socket_info = request_->socket_info;
+  auto& buffer = request_->socket_info->sending_buffer;
+  if (t_pending.buffer == &buffer) {
+    // would wait forever behind this thread's own uncommitted prepare()
+    return false;
+  }
+  ring_string_buffer::reservation r;
+  auto buf = buffer.reserve(r, len);
+  if (!buf) {
+    return false;
+  }
 
-  if (socket_info.sending_buffer.write(msg, len)) {
-    lws_callback_on_writable(request_->wsi);
-    service_->wakeup();
-    return true;
+  memcpy(buf, msg, len);
+  buffer.commit(r, len);
+  service_->request_writable(request_);
+  return true;
+}
+
+char* socket_client::prepare(size_t max_len) noexcept {
+  if (!request_ || !request_->wsi || t_pending.buffer) {
+    return nullptr;
+  }
+
+  auto& buffer = request_->socket_info->sending_buffer;
+  auto buf = buffer.reserve(t_pending.reservation, max_len);
+  if (buf) {
+    t_pending.owner = this;
+    t_pending.buffer = &buffer;
   }
-  return false;
+  return buf;
+}
+
+bool socket_client::commit(size_t len) noexcept {
+  if (!t_pending.buffer || t_pending.owner != this) {
+    return false;
+  }
+
+  // always complete the reservation, the buffer can't be reset until it is
+  t_pending.buffer->commit(t_pending.reservation, len);
+  t_pending.buffer = nullptr;
+  t_pending.owner = nullptr;
+  if (!len || !request_ || !request_->wsi) {
+    return false;
+  }
+
+  service_->request_writable(request_);
+  return true;
 }
 
 int raw_socket_callback(struct lws *wsi, enum lws_callback_reasons reason, void *user, void *in, size_t len) {
@@ -104,12 +200,14 @@ int raw_socket_callback(struct lws *wsi, enum lws_callback_reasons reason, void
     return lws_callback_http_dummy(wsi, reason, user, in, len);
   }
 
-  auto& client = req->socket_info;
+  auto& client = *req->socket_info;
 
   switch (reason) {
     case LWS_CALLBACK_RAW_CONNECTED:
       lwsl_user("%s:%d connected.\n", req->cci.address, req->cci.port);
       client.sending_buffer.reset();
+      client.write_pending.store(false, std::memory_order_relaxed);
+      req->service->connection_established(req, 0);
       client.callback->on_connected();
       client.disconnecte_callback_invoked = false;
       break;
@@ -125,13 +223,13 @@ int raw_socket_callback(struct lws *wsi, enum lws_callback_reasons reason, void
       return -1;
 
     case LWS_CALLBACK_RAW_WRITEABLE: {
-      auto msg = client.sending_buffer.read();
-      if (msg.second) {
-        size_t n = lws_write(wsi, (unsigned char*)msg.first, msg.second, LWS_WRITE_RAW);
-        if (n < len) {
-          req->wsi = nullptr;
-          return -1;
-        }
+      client.write_batch.resize(req->service->options().socket_write_batch);
+      auto written = write_raw_batch(wsi, client.sending_buffer, client.write_batch);
+      if (written < 0) {
+        req->wsi = nullptr;
+        return -1;
+      }
+      if (written || client.write_drained()) {
         lws_callback_on_writable(wsi);
       }
       break;
@@ -156,6 +254,7 @@ int raw_socket_callback(struct lws *wsi, enum lws_callback_reasons reason, void
         client.callback->on_disconnected();
         client.disconnecte_callback_invoked = true;
       }
+      req->service->connection_lost(req);
       break;
 
     default:
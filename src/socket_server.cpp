@@ -25,7 +25,8 @@
 #include "slicksocket/socket_server.h"
 #include "slicksocket/callback.h"
 #include <libwebsockets.h>
-#include "ring_buffer.h"
+#include "socket_service.h"
+#include <vector>
 
 #if defined(_MSC_VER)
 #pragma comment(lib, "Ws2_32.lib")
@@ -46,11 +47,15 @@ const struct lws_protocols s_protocols[] = {
 
 std::unordered_map<struct lws *, ring_string_buffer> clients;
 socket_server_callback_t* callback = nullptr;
+std::vector<char> write_batch;  // shared by all clients, only touched on the service thread
+send_buffer_options send_buffer;
 
 }
 
 void socket_server::serve(int32_t port, int32_t cpu_affinity) {
   callback = callback_;
+  write_batch.resize(write_batch_);
+  send_buffer = send_buffer_;
   lws_context_creation_info context_info;
   memset(&context_info, 0, sizeof(context_info));
 
@@ -66,6 +71,10 @@ void socket_server::serve(int32_t port, int32_t cpu_affinity) {
   }
 
   lwsl_user("socket_server serve on %d\n", port);
+  {
+    std::lock_guard<std::mutex> g(context_mutex_);
+    context_ = context;
+  }
 
   int n = 0;
   while (n >= 0 && run_.load(std::memory_order_relaxed)) {
@@ -73,9 +82,22 @@ void socket_server::serve(int32_t port, int32_t cpu_affinity) {
   }
 
   lwsl_user("socket_server exit. destroying context\n");
+  {
+    std::lock_guard<std::mutex> g(context_mutex_);
+    context_ = nullptr;
+  }
   lws_context_destroy(context);
 }
 
+void socket_server::stop() noexcept {
+  run_.store(false, std::memory_order_release);
+  std::lock_guard<std::mutex> g(context_mutex_);
+  if (context_) {
+    // wake up service loop blocked in poll
+    lws_cancel_service(context_);
+  }
+}
+
 bool socket_server::send(void *client_handle, const char *message, size_t length) {
   auto wsi = reinterpret_cast<lws*>(client_handle);
   auto iter = clients.find(wsi);
@@ -84,11 +106,52 @@ bool socket_server::send(void *client_handle, const char *message, size_t length
   }
 
   auto& buffer = iter->second;
-  buffer.write(message, length);
+  if (t_pending.buffer == &buffer) {
+    // would wait forever behind this thread's own uncommitted prepare()
+    return false;
+  }
+  ring_string_buffer::reservation r;
+  auto buf = buffer.reserve(r, length);
+  if (!buf) {
+    return false;
+  }
+
+  memcpy(buf, message, length);
+  buffer.commit(r, length);
   lws_callback_on_writable(wsi);
   return true;
 }
 
+char* socket_server::prepare(void *client_handle, size_t max_len) {
+  auto iter = clients.find(reinterpret_cast<lws*>(client_handle));
+  if (iter == clients.end() || t_pending.buffer) {
+    return nullptr;
+  }
+
+  auto buf = iter->second.reserve(t_pending.reservation, max_len);
+  if (buf) {
+    t_pending.owner = client_handle;
+    t_pending.buffer = &iter->second;
+  }
+  return buf;
+}
+
+bool socket_server::commit(void *client_handle, size_t len) {
+  if (!t_pending.buffer || t_pending.owner != client_handle) {
+    return false;
+  }
+
+  t_pending.buffer->commit(t_pending.reservation, len);
+  t_pending.buffer = nullptr;
+  t_pending.owner = nullptr;
+  if (!len) {
+    return false;
+  }
+
+  lws_callback_on_writable(reinterpret_cast<lws*>(client_handle));
+  return true;
+}
+
 namespace {
 int raw_socket_server_callback(struct lws *wsi, enum lws_callback_reasons reason, void *user, void *in, size_t len) {
 
@@ -101,10 +164,17 @@ int raw_socket_server_callback(struct lws *wsi, enum lws_callback_reasons reason
       /* callbacks related to raw socket descriptor */
 
     case LWS_CALLBACK_RAW_ADOPT: {
-      auto iter = clients.emplace(wsi, 8192).first;
+      auto iter = clients.emplace(wsi, send_buffer.size).first;
       if (iter == clients.end()) {
         printf("*\n");
       }
+      iter->second.configure(send_buffer, [wsi](bool high, size_t queued) {
+        if (high) {
+          callback->on_send_buffer_high(wsi, queued);
+        } else {
+          callback->on_send_buffer_low(wsi, queued);
+        }
+      });
       callback->on_client_connected(wsi);
       break;
     }
@@ -120,15 +190,12 @@ int raw_socket_server_callback(struct lws *wsi, enum lws_callback_reasons reason
     case LWS_CALLBACK_RAW_WRITEABLE: {
       auto it = clients.find(wsi);
       if (it != clients.end()) {
-        auto &buffer = it->second;
-        auto msg = buffer.read();
-        if (msg.second) {
-          size_t n = lws_write(wsi, (unsigned char *) msg.first, msg.second, LWS_WRITE_RAW);
-          if (n < len) {
-            return -1;
-          }
+        auto written = write_raw_batch(wsi, it->second, write_batch);
+        if (written < 0) {
+          return -1;
+        }
+        if (written) {
           lws_callback_on_writable(wsi);
-          return 1;
         }
       }
       break;
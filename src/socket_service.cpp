@@ -1,13 +1,16 @@
 #include "socket_service.h"
 #include <slicksocket/http_client.h>
+#include <slicksocket/callback.h>
 #include "utils.h"
 #include <mutex>
+#include <algorithm>
 
 #if defined(_MSC_VER)
 #pragma comment(lib, "Ws2_32.lib")
 #endif
 
 #define QUEUE_SIZE 65536
+#define IDLE_SPIN_COUNT 4096
 
 using namespace slick::net;
 
@@ -24,16 +27,6 @@ const struct lws_protocols s_protocols[] = {
     {nullptr, nullptr, 0, 0}
 };
 
-class spin_lock final {
-  std::atomic_flag flag_{false};
- public:
-  spin_lock() = default;
-  ~spin_lock() = default;
-
-  void lock() { while (flag_.test_and_set(std::memory_order_acquire)); }
-  void unlock() { flag_.clear(std::memory_order_release); }
-};
-
 spin_lock s_lock;
 std::unordered_map<std::string, socket_service*> s_global_service;
 
@@ -50,11 +43,18 @@ struct destroyer {
 destroyer s_destroyer;
 }
 
-socket_service::socket_service(std::string ca_file_path, int32_t cpu_affinity, bool is_global)
-    : request_pool_(QUEUE_SIZE)
+socket_service::socket_service(std::string ca_file_path,
+                               int32_t cpu_affinity,
+                               bool is_global,
+                               const service_options& options)
+    : http_pool_(options.request_pool_size, options.request_pool_reserve)
+    , socket_pool_(options.request_pool_size, options.request_pool_reserve)
     , request_queue_(QUEUE_SIZE)
+    , writable_queue_(QUEUE_SIZE)
     , ca_file_path_(std::move(ca_file_path))
-    , is_global_(is_global) {
+    , is_global_(is_global)
+    , options_(options)
+    , rng_(std::random_device()()) {
   lws_context_creation_info context_info;
   memset(&context_info, 0, sizeof(context_info));
 
@@ -65,63 +65,111 @@ socket_service::socket_service(std::string ca_file_path, int32_t cpu_affinity, b
   context_info.ka_probes = 5;
   context_info.ka_interval = 1;
 
+  memset(&idle_policy_, 0, sizeof(idle_policy_));
+  if (options_.http_keep_alive || options_.http2) {
+    context_info.keepalive_timeout = options_.http_idle_timeout;
+    idle_policy_.secs_since_valid_ping = options_.http_idle_timeout;
+    idle_policy_.secs_since_valid_hangup = options_.http_idle_timeout;
+  }
+
   if (!ca_file_path_.empty()) {
     context_info.client_ssl_ca_filepath = ca_file_path_.c_str();
   }
 
+  setup_extensions(context_info);
+
   context_ = lws_create_context(&context_info);
   if (context_) {
     thread_ = std::thread([this, cpu_affinity]() { serve(cpu_affinity); });
   }
 }
 
-socket_service* socket_service::global(const std::string& ca_file_path, int32_t cpu_affinity) noexcept {
+socket_service* socket_service::global(const std::string& ca_file_path,
+                                       int32_t cpu_affinity,
+                                       const service_options& options) noexcept {
   std::lock_guard<spin_lock> g(s_lock);
   auto it = s_global_service.find(ca_file_path);
   if (it == s_global_service.end()) {
-    it = s_global_service.emplace(ca_file_path, new socket_service(ca_file_path, cpu_affinity, true)).first;
+    it = s_global_service.emplace(ca_file_path, new socket_service(ca_file_path, cpu_affinity, true, options)).first;
   }
+  it->second->attach();
   return it->second;
 }
 
 void socket_service::serve(int32_t cpu_affinity) {
   uint64_t sn = 0;
+  uint32_t idle_count = 0;
+  // busy_spin never blocks in poll, others block until an event or lws_cancel_service
+  int service_timeout = options_.strategy == wait_strategy::busy_spin ? -1 : 0;
   set_cpu_affinity(cpu_affinity);
   while (run_.load(std::memory_order_relaxed)) {
     sn = request_queue_.available();
     if (cursor_ != sn) {
-      auto req = request_queue_[cursor_++];
-      auto &cci = req->cci;
-      cci.context = context_;
-      req->service = this;
-      requests_.emplace(req);
-      lwsl_user("Connecting to %s:%d%s\n", cci.address, cci.port, cci.path);
-      lws_client_connect_via_info(&cci);
+      if (options_.max_requests_per_poll && sn - cursor_ > options_.max_requests_per_poll) {
+        sn = cursor_ + options_.max_requests_per_poll;
+      }
+      while (cursor_ != sn) {
+        auto req = request_queue_[cursor_++];
+        auto &cci = req->cci;
+        cci.context = context_;
+        if (req->type == request_type::http) {
+          apply_http_options(cci);
+        }
+        req->service = this;
+        requests_.emplace(req);
+        lwsl_user("Connecting to %s:%d%s\n", cci.address, cci.port, cci.path);
+        lws_client_connect_via_info(&cci);
+      }
     }
     
+    drain_writable();
+
     if (requests_.empty()) {
-      std::this_thread::yield();
+      idle_wait(idle_count++);
       continue;
     }
 
-    lws_service(context_, 0);
+    idle_count = 0;
+    auto timeout = service_timeout;
+    if (timeout == 0) {
+      // senders only cancel the poll while we are blocked in it
+      polling_.store(true, std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+      if (request_queue_.available() != cursor_ || writable_queue_.available() != writable_cursor_) {
+        // more work queued, still service the connections and complete requests but don't block.
+        // Keeps max_requests_per_poll batches one poll apart.
+        polling_.store(false, std::memory_order_relaxed);
+        timeout = -1;
+      }
+    }
+    lws_service(context_, timeout);
+    polling_.store(false, std::memory_order_relaxed);
+    wake_pending_.store(false, std::memory_order_relaxed);
 
     for (auto it = requests_.begin(); it != requests_.end();) {
       auto req = *it;
       if (!req->wsi) {
         if (req->type == request_type::http) {
-          auto& http_info = req->http_info;
-          http_info.completed.store(true, std::memory_order_release);
+          auto& http_info = *req->http_info;
+          it = requests_.erase(it);
           if (http_info.callback) {
-            http_info.callback(http_response(http_info.status, http_info.content_type, http_info.response.str()));
-            request_pool_.release_obj(req);
+            http_info.callback(http_response(http_info.status, http_info.content_type, std::move(http_info.response)));
+            release_request(req);
+          } else if (http_info.stream_callback) {
+            // only error message is accumulated in streaming mode
+            http_info.stream_callback(http_info.status, http_info.response.data(), http_info.response.size(), true);
+            release_request(req);
+          } else {
+            // synchronous request, the caller releases it as soon as it sees completed. Last touch.
+            http_info.completed.store(true, std::memory_order_release);
           }
-          it = requests_.erase(it);
         } else if (req->type == request_type::ws || req->type == request_type::socket) {
-          auto& socket_info = req->socket_info;
+          auto& socket_info = *req->socket_info;
           if (socket_info.shutdown.load(std::memory_order_relaxed)) {
             // client shutdown
-            request_pool_.release_obj(req);
+            lws_sul_schedule(context_, 0, &socket_info.reconnect_timer.sul, reconnect, LWS_SET_TIMER_USEC_CANCEL);
+            socket_info.cancel_ping(context_);
+            release_request(req);
             it = requests_.erase(it);
           } else {
             ++it;
@@ -132,6 +180,169 @@ void socket_service::serve(int32_t cpu_affinity) {
       }
     }
   }
+  served_.store(true, std::memory_order_release);
+}
+
+void socket_service::idle_wait(uint32_t idle_count) {
+  if (options_.strategy == wait_strategy::busy_spin
+      || (options_.strategy == wait_strategy::spin_then_park && idle_count < IDLE_SPIN_COUNT)) {
+    std::this_thread::yield();
+    return;
+  }
+  park();
+}
+
+void socket_service::park() {
+  std::unique_lock<std::mutex> lock(park_mutex_);
+  parked_.store(true, std::memory_order_relaxed);
+  // pairs with the fence in wake(), either we see the new request or wake() sees parked_
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  park_cond_.wait(lock, [this]() {
+    return !run_.load(std::memory_order_relaxed)
+        || request_queue_.available() != cursor_
+        || writable_queue_.available() != writable_cursor_;
+  });
+  parked_.store(false, std::memory_order_relaxed);
+}
+
+void socket_service::apply_http_options(lws_client_connect_info& cci) {
+  if (!options_.http_keep_alive && !options_.http2) {
+    return;
+  }
+
+  // queue on an existing connection to the same endpoint if there is one.
+  // For h2 the request becomes a new stream on that connection.
+  cci.ssl_connection |= LCCSCF_PIPELINE;
+  cci.retry_and_idle_policy = &idle_policy_;
+
+  if (options_.http2 && (cci.ssl_connection & LCCSCF_USE_SSL)) {
+    cci.alpn = "h2,http/1.1";
+    cci.ssl_connection |= LCCSCF_H2_QUIRK_OVERFLOWS_TXCR | LCCSCF_H2_QUIRK_NGHTTP2_END_STREAM;
+    if (options_.http2_stream_window > 0) {
+      cci.ssl_connection |= LCCSCF_H2_MANUAL_RXFLOW;
+      cci.manual_initial_tx_credit = options_.http2_stream_window;
+    }
+  }
+}
+
+void socket_service::setup_extensions(lws_context_creation_info& context_info) {
+  memset(extensions_, 0, sizeof(extensions_));
+  auto& deflate = options_.ws_compression;
+  if (!deflate.enabled) {
+    return;
+  }
+
+#if defined(LWS_WITHOUT_EXTENSIONS)
+  lwsl_warn("libwebsockets is built without extensions, permessage-deflate is disabled\n");
+#else
+  auto window_bits = [](uint8_t bits) { return std::to_string(std::min<uint8_t>(std::max<uint8_t>(bits, 8), 15)); };
+
+  // 15 bits is the protocol default, only narrower windows need to be spelled out
+  deflate_offer_ = "permessage-deflate; client_max_window_bits";
+  if (deflate.client_max_window_bits < 15) {
+    deflate_offer_ += "=" + window_bits(deflate.client_max_window_bits);
+  }
+  if (deflate.server_max_window_bits < 15) {
+    deflate_offer_ += "; server_max_window_bits=" + window_bits(deflate.server_max_window_bits);
+  }
+  if (deflate.client_no_context_takeover) {
+    deflate_offer_ += "; client_no_context_takeover";
+  }
+  if (deflate.server_no_context_takeover) {
+    deflate_offer_ += "; server_no_context_takeover";
+  }
+
+  extensions_[0].name = "permessage-deflate";
+  extensions_[0].callback = lws_extension_callback_pm_deflate;
+  extensions_[0].client_offer = deflate_offer_.c_str();
+  context_info.extensions = extensions_;
+#endif
+}
+
+void socket_service::connection_established(request_info* req, size_t headroom) {
+  auto& info = *req->socket_info;
+  info.reconnect_attempts = 0;
+
+  char address[64];
+  if (info.reconnect.reuse_resolved_address && lws_get_peer_simple(req->wsi, address, sizeof(address))) {
+    info.resolved_address = address;
+  }
+
+  if (!info.subscriptions) {
+    return;
+  }
+
+  size_t queued = 0;
+  {
+    std::lock_guard<spin_lock> g(info.subscriptions->lock);
+    for (auto& msg : info.subscriptions->messages) {
+      ring_string_buffer::reservation r;
+      auto buf = info.sending_buffer.reserve(r, msg.first.size(), headroom, msg.second);
+      if (!buf) {
+        lwsl_warn("%s:%d send buffer full, subscription dropped\n", req->cci.host, req->cci.port);
+        continue;
+      }
+      memcpy(buf, msg.first.data(), msg.first.size());
+      info.sending_buffer.commit(r, msg.first.size());
+      ++queued;
+    }
+  }
+
+  if (queued) {
+    info.write_pending.store(true, std::memory_order_relaxed);
+    lws_callback_on_writable(req->wsi);
+  }
+}
+
+void socket_service::connection_lost(request_info* req) {
+  auto& info = *req->socket_info;
+  auto& options = info.reconnect;
+  // lws may report the loss of a connection more than once
+  if (!options.enabled || info.reconnect_scheduled || info.shutdown.load(std::memory_order_relaxed)) {
+    return;
+  }
+  if (options.max_attempts && info.reconnect_attempts >= options.max_attempts) {
+    lwsl_user("%s:%d giving up after %u reconnect attempts\n", req->cci.host, req->cci.port, info.reconnect_attempts);
+    return;
+  }
+
+  auto delay = options.delay_ms(info.reconnect_attempts, rng_());
+
+  ++info.reconnect_attempts;
+  info.reconnect_scheduled = true;
+  info.reconnect_timer.req = req;
+  lwsl_user("%s:%d reconnecting in %llums\n", req->cci.host, req->cci.port, (unsigned long long)delay);
+  info.callback->on_reconnecting(info.reconnect_attempts, static_cast<uint32_t>(delay));
+  lws_sul_schedule(context_, 0, &info.reconnect_timer.sul, reconnect, delay * LWS_US_PER_MS);
+}
+
+void socket_service::reconnect(lws_sorted_usec_list_t* sul) {
+  auto req = reinterpret_cast<request_timer*>(sul)->req;
+  auto& info = *req->socket_info;
+  info.reconnect_scheduled = false;
+  if (info.shutdown.load(std::memory_order_relaxed) || req->wsi) {
+    return;
+  }
+
+  // the first attempt goes straight to the last known address, later ones resolve the host again
+  auto& cci = req->cci;
+  cci.address = (info.reconnect_attempts == 1 && !info.resolved_address.empty())
+      ? info.resolved_address.c_str()
+      : cci.host;
+  if (!lws_client_connect_via_info(&cci)) {
+    req->service->connection_lost(req);
+  }
+}
+
+void socket_service::drain_writable() {
+  auto sn = writable_queue_.available();
+  while (writable_cursor_ != sn) {
+    auto req = writable_queue_[writable_cursor_++];
+    // the request may have been released since it was queued
+    if (requests_.count(req) && req->wsi) {
+      lws_callback_on_writable(req->wsi);
+    }
+  }
 }
 
 void socket_service::notify_all() const {
@@ -26,10 +26,20 @@
 
 #include <libwebsockets.h>
 #include <atomic>
-#include <sstream>
+#include <string>
 #include <functional>
 #include <unordered_set>
+#include <mutex>
+#include <condition_variable>
+#include <memory>
+#include <vector>
+#include <random>
+#include <chrono>
+#include <thread>
+#include <cstring>
+#include <slicksocket/service_options.h>
 #include "ring_buffer.h"
+#include "message_assembler.h"
 
 namespace slick {
 namespace net {
@@ -38,6 +48,7 @@ class socket_service;
 
 class client_callback_t;
 struct http_request;
+struct request_info;
 struct http_response;
 
 enum class request_type {
@@ -50,32 +61,136 @@ struct http_info {
   uint32_t status = 0;
   std::shared_ptr<http_request> request;
   std::function<void(http_response)> callback = nullptr;
-  std::stringstream response;
+  std::function<void(int32_t, const char*, size_t, bool)> stream_callback = nullptr;
+  std::string response;
   char content_type[512];
   char buffer[8192 + LWS_PRE];
   char *px = buffer + LWS_PRE;
   int buffer_len = sizeof(buffer) - LWS_PRE;
+  size_t body_sent = 0;
   std::atomic_bool completed {false};
+
+  void reset() noexcept {
+    callback = nullptr;
+    stream_callback = nullptr;
+    status = 0;
+    body_sent = 0;
+    response.clear();
+    content_type[0] = '\0';
+    completed.store(false, std::memory_order_relaxed);
+  }
+};
+
+/**
+ * Messages sent first thing on every established connection, shared by a client and its requests
+ */
+struct subscription_list {
+  spin_lock lock;
+  std::vector<std::pair<std::string, uint8_t>> messages;   // content and send buffer tag
+};
+
+struct request_timer {
+  lws_sorted_usec_list_t sul;   // must stay first, the timer callback casts it back
+  request_info* req = nullptr;
 };
 
 struct socket_info {
   client_callback_t *callback = nullptr;
   ring_string_buffer sending_buffer {8192};
+  std::vector<char> write_batch;  // raw socket only, gathers queued messages into one write
   std::atomic_bool shutdown {false};
+  std::atomic_bool write_pending {false};  // a writeable callback is requested or sending_buffer is being drained
+  bool reassemble {false};                 // ws only, deliver whole messages
+  message_assembler assembler;             // ws only, fragments of the message being reassembled
+  std::shared_ptr<subscription_list> subscriptions;
+  std::shared_ptr<std::atomic<uint32_t>> held;   // ws only, client's count of connections not released yet
+  reconnect_options reconnect;
+  uint32_t reconnect_attempts = 0;        // consecutive attempts since the last established connection
+  bool reconnect_scheduled = false;
+  request_timer reconnect_timer;
+  std::string resolved_address;           // peer address of the last established connection
+  ping_options ping;                      // ws only
+  request_timer ping_timer;
+  request_timer pong_timer;
+  uint64_t ping_sent_ns = 0;
+  bool ping_due = false;
+  bool pong_pending = false;
+  std::atomic<uint64_t> last_rtt_ns {0};
+  std::atomic<uint64_t> smoothed_rtt_ns {0};
   bool disconnecte_callback_invoked {false};
 
-  socket_info() = default;
-  socket_info(client_callback_t* cb) : callback(cb) {}
+  socket_info() {
+    for (auto timer : {&reconnect_timer, &ping_timer, &pong_timer}) {
+      memset(&timer->sul, 0, sizeof(timer->sul));
+    }
+  }
+  socket_info(client_callback_t* cb) : socket_info() { callback = cb; }
+
+  /**
+   * Service thread only. Stop the ping and pong timeout timers.
+   */
+  void cancel_ping(lws_context* context) noexcept {
+    ping_due = false;
+    pong_pending = false;
+    lws_sul_schedule(context, 0, &ping_timer.sul, nullptr, LWS_SET_TIMER_USEC_CANCEL);
+    lws_sul_schedule(context, 0, &pong_timer.sul, nullptr, LWS_SET_TIMER_USEC_CANCEL);
+  }
+
+  /**
+   * Called on the service thread when sending_buffer is found empty.
+   * @return True if a message was committed meanwhile and another writeable callback is needed.
+   */
+  bool write_drained() noexcept {
+    write_pending.store(false, std::memory_order_relaxed);
+    // pairs with the fence in socket_service::request_writable()
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    return !sending_buffer.empty() && !write_pending.exchange(true, std::memory_order_relaxed);
+  }
 };
 
+/**
+ * Reservation made by a producer between prepare() and commit(), kept per thread.
+ * owner is the client that called prepare(), commit() on any other client is rejected.
+ */
+struct pending_write {
+  const void* owner = nullptr;
+  ring_string_buffer* buffer = nullptr;
+  ring_string_buffer::reservation reservation;
+};
+
+// one prepare() in flight per producer thread, shared by all client types
+inline thread_local pending_write t_pending;
+
+/**
+ * Service thread only. Write the next queued chunk of a raw socket: as many whole messages
+ * as fit in batch, or the next message alone.
+ * @param batch   Scratch buffer, its size is the batch budget. Empty disables batching.
+ * @return        -1 if the write failed, 0 if nothing was queued, 1 if a chunk was written.
+ */
+inline int write_raw_batch(lws* wsi, ring_string_buffer& buffer, std::vector<char>& batch) noexcept {
+  std::pair<const char*, size_t> msg {batch.data(), 0};
+  if (!batch.empty()) {
+    msg.second = buffer.read_into(batch.data(), batch.size());
+  }
+  if (!msg.second) {
+    // batching disabled or next message exceeds the budget
+    msg = buffer.read();
+  }
+  if (!msg.first || !msg.second) {
+    return 0;
+  }
+  auto n = lws_write(wsi, (unsigned char*)msg.first, msg.second, LWS_WRITE_RAW);
+  return n < (int)msg.second ? -1 : 1;
+}
+
 struct request_info {
   lws *wsi = nullptr;
   socket_service* service = nullptr;
   request_type type;
   std::string path;
   lws_client_connect_info cci;
-  struct http_info http_info;
-  struct socket_info socket_info;
+  std::unique_ptr<struct http_info> http_info;      // http requests only
+  std::unique_ptr<struct socket_info> socket_info;  // ws and socket requests only
 };
 
 class socket_service {
@@ -84,23 +199,62 @@ class socket_service {
   lws_context *context_ = nullptr;
   uint64_t cursor_ = 0;
   std::atomic_bool run_{true};
-  object_pool<request_info> request_pool_;
+  std::atomic_bool served_{false};    // serve() returned, the thread no longer touches the service
+  object_pool<request_info> http_pool_;
+  object_pool<request_info> socket_pool_;
   ring_buffer<request_info*> request_queue_;
+  ring_buffer<request_info*> writable_queue_;
+  uint64_t writable_cursor_ = 0;
   std::string ca_file_path_;
   bool is_global_ = false;
+  bool shared_ = false;
+  std::atomic_uint32_t clients_{0};
   std::unordered_set<request_info*> requests_;
+  service_options options_;
+  lws_retry_bo_t idle_policy_;
+  std::string deflate_offer_;
+  lws_extension extensions_[2];
+  std::atomic_bool parked_{false};
+  std::atomic_bool polling_{false};        // service thread is or is about to be blocked in lws_service
+  std::atomic_bool wake_pending_{false};   // lws_cancel_service issued during the current poll
+  std::mutex park_mutex_;
+  std::condition_variable park_cond_;
+  std::minstd_rand rng_;    // reconnect jitter, service thread only
 
  public:
-  static socket_service* global(const std::string& ca_file_path, int32_t cpu_affinity) noexcept;
+  /**
+   * Global service shared by all clients using the same ca_file_path.
+   * NOTE: cpu_affinity and options only take effect when the service is first created.
+   */
+  static socket_service* global(const std::string& ca_file_path,
+                                int32_t cpu_affinity,
+                                const service_options& options = service_options()) noexcept;
 
-  socket_service(std::string ca_file_path, int32_t cpu_affinity = -1, bool is_global = false);
+  socket_service(std::string ca_file_path,
+                 int32_t cpu_affinity = -1,
+                 bool is_global = false,
+                 const service_options& options = service_options());
 
   ~socket_service() {
     run_.store(false, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    unpark();
+    if (context_) {
+      lws_cancel_service(context_);
+    }
 
     if (thread_.joinable()) {
       if (is_global_) {
         thread_.detach();
+        // destroyed at exit, where the thread may already be gone. Wait a bounded time for serve() to return.
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(1);
+        while (!served_.load(std::memory_order_acquire) && std::chrono::steady_clock::now() < deadline) {
+          std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        if (!served_.load(std::memory_order_acquire)) {
+          // still inside serve(), its context and requests can't be touched
+          return;
+        }
       }
       else {
         thread_.join();
@@ -111,43 +265,162 @@ class socket_service {
       lws_context_destroy(context_);
       context_ = nullptr;
     }
+
+    for (auto req : requests_) {
+      release_request(req);
+    }
+    requests_.clear();
   }
 
   bool is_global() const noexcept { return is_global_; };
 
+  /**
+   * Shared services are owned by the global registry or a service_group, not by a client.
+   */
+  bool is_shared() const noexcept { return is_global_ || shared_; }
+
+  // number of clients attached to a shared service
+  void attach() noexcept { clients_.fetch_add(1, std::memory_order_relaxed); }
+  void detach() noexcept { clients_.fetch_sub(1, std::memory_order_relaxed); }
+  uint32_t clients() const noexcept { return clients_.load(std::memory_order_relaxed); }
+
+  const service_options& options() const noexcept { return options_; }
+
   request_info* get_request_info(request_type type) {
     if (!context_) {
       return nullptr;
     }
-    auto obj = request_pool_.get_obj();
-    if (obj) {
-      obj->type = type;
+
+    // http and socket requests are pooled separately so each only carries its own state
+    auto obj = type == request_type::http ? http_pool_.get_obj() : socket_pool_.get_obj();
+    if (!obj) {
+      return nullptr;
+    }
+
+    obj->type = type;
+    if (type == request_type::http) {
+      if (!obj->http_info) {
+        obj->http_info.reset(new (std::nothrow) http_info);
+      }
+      if (obj->http_info) {
+        obj->http_info->reset();
+        return obj;
+      }
+    } else {
+      if (!obj->socket_info) {
+        obj->socket_info.reset(new (std::nothrow) socket_info);
+      }
+      if (obj->socket_info) {
+        return obj;
+      }
     }
-    return obj;
+
+    delete obj;
+    return nullptr;
   }
 
   void release_request(request_info* req) {
-    request_pool_.release_obj(req);
+    if (req->type == request_type::http) {
+      http_pool_.release_obj(req);
+    } else {
+      if (req->socket_info && req->socket_info->held) {
+        // last touch of the request, the client may be waiting to destroy its callback
+        req->socket_info->held->fetch_sub(1, std::memory_order_release);
+        req->socket_info->held.reset();
+      }
+      socket_pool_.release_obj(req);
+    }
   }
 
   void request(request_info* req) {
-    auto slot = request_queue_.reserve();
-    slot[0] = req;
+    request(&req, 1);
+  }
+
+  /**
+   * Submit several requests at once. They are published with a single cursor advance
+   * and the service is woken up once.
+   */
+  void request(request_info* const* reqs, size_t count) {
+    if (!count) {
+      return;
+    }
+    auto slot = request_queue_.reserve(count);
+    for (size_t i = 0; i < count; ++i) {
+      slot[i] = reqs[i];
+    }
     slot.publish();
-    // wake up service waiting
-    lws_cancel_service(context_);
+    wake();
   }
 
-  void wakeup() {
-      lws_cancel_service(context_);
+  /**
+   * Request a writeable callback for a ws or socket request from any thread.
+   * Requests are coalesced: once one is pending, further calls return without touching
+   * the service thread until it finds the send buffer drained.
+   * @param force   Queue the request even if one is pending, e.g. to deliver a shutdown.
+   */
+  void request_writable(request_info* req, bool force = false) {
+    // pairs with the fence in socket_info::write_drained()
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (req->socket_info->write_pending.exchange(true, std::memory_order_relaxed) && !force) {
+      return;
+    }
+    auto slot = writable_queue_.reserve();
+    slot[0] = req;
+    slot.publish();
+    wake();
   }
 
+  /**
+   * Service thread only. Called by ws and socket callbacks once a connection is established:
+   * replays subscriptions and resets the reconnect backoff.
+   * @param headroom    Bytes reserved in front of each queued message
+   */
+  void connection_established(request_info* req, size_t headroom);
+
+  /**
+   * Service thread only. Called by ws and socket callbacks when the connection is gone,
+   * schedules a reconnect if enabled and the client is not stopped.
+   */
+  void connection_lost(request_info* req);
+
   // This is for internal use only
   void notify_all() const;
 
  private:
+  friend class service_group;
+
   void serve(int32_t cpu_affinity);
- 
+
+  void idle_wait(uint32_t idle_count);
+
+  void apply_http_options(lws_client_connect_info& cci);
+
+  // must run before the context is created, lws keeps pointers to the extension table
+  void setup_extensions(lws_context_creation_info& context_info);
+
+  void park();
+
+  // handle writeable requests queued by request_writable()
+  void drain_writable();
+
+  static void reconnect(lws_sorted_usec_list_t* sul);
+
+  void wake() {
+    // pairs with the fences in park() and serve(), either the service sees the new entry or we see it waiting
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    unpark();
+    if (polling_.load(std::memory_order_relaxed) && !wake_pending_.exchange(true, std::memory_order_relaxed)) {
+      lws_cancel_service(context_);
+    }
+  }
+
+  void unpark() {
+    if (parked_.load(std::memory_order_relaxed)) {
+      std::lock_guard<std::mutex> g(park_mutex_);
+      park_cond_.notify_one();
+    }
+  }
+
 };
 
 }
@@ -24,23 +24,117 @@
 
 #include "slicksocket/websocket_client.h"
 #include "slicksocket/callback.h"
+#include "slicksocket/service_group.h"
 #include <atomic>
-#include <array>
+#include <chrono>
+#include <thread>
 #include "socket_service.h"
 
+#define WS_TAG_NO_FIN 0x80
+
 using namespace slick::net;
 
+namespace {
+
+
+uint8_t to_tag(ws_opcode opcode, bool final) {
+  // frame type travels with the message as its tag
+  return static_cast<uint8_t>(opcode) | (final ? 0 : WS_TAG_NO_FIN);
+}
+
+uint64_t now_ns() noexcept {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void ping_timer_expired(lws_sorted_usec_list_t* sul) {
+  auto req = reinterpret_cast<request_timer*>(sul)->req;
+  if (!req->wsi) {
+    return;
+  }
+
+  auto& client = *req->socket_info;
+  // the pong timeout deals with a ping left unanswered
+  if (!client.pong_pending) {
+    client.ping_due = true;
+    lws_callback_on_writable(req->wsi);
+  }
+  lws_sul_schedule(lws_get_context(req->wsi), 0, sul, ping_timer_expired, client.ping.interval_ms * LWS_US_PER_MS);
+}
+
+void pong_timer_expired(lws_sorted_usec_list_t* sul) {
+  auto req = reinterpret_cast<request_timer*>(sul)->req;
+  auto& client = *req->socket_info;
+  if (!req->wsi || !client.pong_pending) {
+    return;
+  }
+
+  lwsl_user("%s:%d pong timeout\n", req->cci.host, req->cci.port);
+  static const char err[] = "pong timeout";
+  client.callback->on_error(err, sizeof(err) - 1);
+  lws_set_timeout(req->wsi, PENDING_TIMEOUT_USER_OK, LWS_TO_KILL_ASYNC);
+}
+
+lws_write_protocol to_write_protocol(uint8_t tag) {
+  int protocol = LWS_WRITE_TEXT;
+  switch (static_cast<ws_opcode>(tag & ~WS_TAG_NO_FIN)) {
+    case ws_opcode::text:
+      protocol = LWS_WRITE_TEXT;
+      break;
+    case ws_opcode::binary:
+      protocol = LWS_WRITE_BINARY;
+      break;
+    case ws_opcode::continuation:
+      protocol = LWS_WRITE_CONTINUATION;
+      break;
+  }
+  if (tag & WS_TAG_NO_FIN) {
+    protocol |= LWS_WRITE_NO_FIN;
+  }
+  return static_cast<lws_write_protocol>(protocol);
+}
+
+}
+
 websocket_client::websocket_client(client_callback_t *callback,
                                    std::string url,
                                    std::string origin,
                                    std::string ca_file_path,
                                    int32_t cpu_affinity,
-                                   bool use_global_service)
+                                   bool use_global_service,
+                                   const service_options& options)
+  : websocket_client(callback,
+                     std::move(url),
+                     std::move(origin),
+                     use_global_service
+                         ? socket_service::global(ca_file_path, cpu_affinity, options)
+                         : new socket_service(std::move(ca_file_path), cpu_affinity, false, options)) {
+  send_buffer_ = options.send_buffer;
+  reconnect_ = options.reconnect;
+  ping_ = options.ws_ping;
+}
+
+websocket_client::websocket_client(client_callback_t *callback,
+                                   std::string url,
+                                   std::string origin,
+                                   service_group& group,
+                                   uint64_t shard_key)
+  : websocket_client(callback, std::move(url), std::move(origin), group.assign(shard_key)) {
+}
+
+websocket_client::websocket_client(client_callback_t *callback,
+                                   std::string url,
+                                   std::string origin,
+                                   socket_service* service)
   : callback_(callback)
-  , service_(use_global_service
-      ? socket_service::global(ca_file_path, cpu_affinity) : new socket_service(std::move(ca_file_path), cpu_affinity))
+  , service_(service)
   , url_(std::move(url))
-  , origin_(std::move(origin)) {
+  , origin_(std::move(origin))
+  , send_buffer_(service->options().send_buffer)
+  , reconnect_(service->options().reconnect)
+  , ping_(service->options().ws_ping)
+  , subscriptions_(std::make_shared<subscription_list>())
+  , held_(std::make_shared<std::atomic<uint32_t>>(0)) {
 
   std::string protoco("wss");
   auto pos = url_.find("://");
@@ -82,16 +176,20 @@ websocket_client::websocket_client(client_callback_t *callback,
 }
 
 websocket_client::~websocket_client() noexcept {
-  if (service_ && !service_->is_global()) {
-    delete service_;
+  stop();
+  if (service_) {
+    if (service_->is_shared()) {
+      service_->detach();
+    } else {
+      delete service_;
+    }
     service_ = nullptr;
   }
-  stop();
 }
 
 bool websocket_client::connect() noexcept {
   if (request_) {
-    request_->socket_info.shutdown.store(true, std::memory_order_relaxed);
+    request_->socket_info->shutdown.store(true, std::memory_order_relaxed);
   }
 
   request_ = service_->get_request_info(request_type::ws);
@@ -115,45 +213,123 @@ bool websocket_client::connect() noexcept {
     request_->cci.ssl_connection = LCCSCF_USE_SSL;
   }
 
-  auto& socket_info = request_->socket_info;
+  auto& socket_info = *request_->socket_info;
   socket_info.callback = callback_;
+  socket_info.sending_buffer.resize(send_buffer_.size);
   socket_info.sending_buffer.reset();
+  socket_info.sending_buffer.configure(send_buffer_, [cb = callback_](bool high, size_t queued) {
+    if (high) {
+      cb->on_send_buffer_high(queued);
+    } else {
+      cb->on_send_buffer_low(queued);
+    }
+  });
   socket_info.shutdown.store(false, std::memory_order_relaxed);
+  socket_info.write_pending.store(false, std::memory_order_relaxed);
+  socket_info.reassemble = reassemble_;
+  socket_info.assembler.clear();
+  socket_info.assembler.set_max_size(max_message_size_);
+  socket_info.subscriptions = subscriptions_;
+  socket_info.reconnect = reconnect_;
+  socket_info.ping = ping_;
+  socket_info.last_rtt_ns.store(0, std::memory_order_relaxed);
+  socket_info.smoothed_rtt_ns.store(0, std::memory_order_relaxed);
+  socket_info.reconnect_attempts = 0;
+  socket_info.reconnect_scheduled = false;
+  socket_info.resolved_address.clear();
+  socket_info.held = held_;
+  held_->fetch_add(1, std::memory_order_relaxed);
   service_->request(request_);
   return true;
 }
 
 void websocket_client::stop() noexcept {
   if (request_) {
-    request_->socket_info.shutdown.store(true, std::memory_order_relaxed);
-    if (request_->wsi) {
-      lws_callback_on_writable(request_->wsi);
-    }
-    service_->wakeup();
+    request_->socket_info->shutdown.store(true, std::memory_order_relaxed);
+    // any callback closes the connection once shutdown is set
+    service_->request_writable(request_, true);
     request_ = nullptr;
   }
 }
 
-bool websocket_client::send(const char *msg, size_t len) noexcept {
+void websocket_client::wait_stopped() noexcept {
+  while (held_->load(std::memory_order_acquire)) {
+    std::this_thread::yield();
+  }
+}
+
+uint64_t websocket_client::last_rtt_ns() const noexcept {
+  auto req = request_;
+  return req ? req->socket_info->last_rtt_ns.load(std::memory_order_relaxed) : 0;
+}
+
+uint64_t websocket_client::smoothed_rtt_ns() const noexcept {
+  auto req = request_;
+  return req ? req->socket_info->smoothed_rtt_ns.load(std::memory_order_relaxed) : 0;
+}
+
+void websocket_client::add_subscription(const char* msg, size_t len, ws_opcode opcode) {
+  std::lock_guard<spin_lock> g(subscriptions_->lock);
+  subscriptions_->messages.emplace_back(std::string(msg, len), to_tag(opcode, true));
+}
+
+void websocket_client::clear_subscriptions() noexcept {
+  std::lock_guard<spin_lock> g(subscriptions_->lock);
+  subscriptions_->messages.clear();
+}
+
+bool websocket_client::send(const char *msg, size_t len, ws_opcode opcode, bool final) noexcept {
   if (!request_ || !request_->wsi) {
     return false;
   }
 
-  static std::array<char, LWS_PRE> header{'0'};
+  // reserve with space for LWS header in front of the payload
+  auto& buffer = request_->socket_info->sending_buffer;
+  if (t_pending.buffer == &buffer) {
+    // would wait forever behind this thread's own uncommitted prepare()
+    return false;
+  }
+  ring_string_buffer::reservation r;
+  auto buf = buffer.reserve(r, len, LWS_PRE, to_tag(opcode, final));
+  if (!buf) {
+    return false;
+  }
+
+  memcpy(buf, msg, len);
+  buffer.commit(r, len);
+  service_->request_writable(request_);
+  return true;
+}
+
+char* websocket_client::prepare(size_t max_len, ws_opcode opcode, bool final) noexcept {
+  if (!request_ || !request_->wsi || t_pending.buffer) {
+    return nullptr;
+  }
 
-  auto& socket_info = request_->socket_info;
+  auto& buffer = request_->socket_info->sending_buffer;
+  auto buf = buffer.reserve(t_pending.reservation, max_len, LWS_PRE, to_tag(opcode, final));
+  if (buf) {
+    t_pending.owner = this;
+    t_pending.buffer = &buffer;
+  }
+  return buf;
+}
 
-  // reserve space for LWS header
-  if (!socket_info.sending_buffer.write(&header[0], LWS_PRE, len)) {
+bool websocket_client::commit(size_t len) noexcept {
+  if (!t_pending.buffer || t_pending.owner != this) {
     return false;
   }
 
-  if (socket_info.sending_buffer.write(msg, len)) {
-    lws_callback_on_writable(request_->wsi);
-    service_->wakeup();
-    return true;
+  // always complete the reservation, the buffer can't be reset until it is
+  t_pending.buffer->commit(t_pending.reservation, len);
+  t_pending.buffer = nullptr;
+  t_pending.owner = nullptr;
+  if (!len || !request_ || !request_->wsi) {
+    return false;
   }
-  return false;
+
+  service_->request_writable(request_);
+  return true;
 }
 
 int ws_callback(struct lws *wsi, enum lws_callback_reasons reason, void *user, void *in, size_t len) {
@@ -166,11 +342,14 @@ int ws_callback(struct lws *wsi, enum lws_callback_reasons reason, void *user, v
   if (req->type != request_type::ws) {
     if (reason == LWS_CALLBACK_WSI_DESTROY) {
       req->wsi = nullptr;
+      if (req->type == request_type::socket) {
+        req->service->connection_lost(req);
+      }
     }
     return lws_callback_http_dummy(wsi, reason, user, in, len);
   }
 
-  auto& client = req->socket_info;
+  auto& client = *req->socket_info;
   if (client.shutdown.load(std::memory_order_relaxed)) {
       if (req->wsi) {
           req->wsi = nullptr;
@@ -186,26 +365,105 @@ int ws_callback(struct lws *wsi, enum lws_callback_reasons reason, void *user, v
 
     case LWS_CALLBACK_CLIENT_ESTABLISHED:
       client.sending_buffer.reset();
+      client.write_pending.store(false, std::memory_order_relaxed);
+      client.assembler.clear();
+      req->service->connection_established(req, LWS_PRE);
+      client.last_rtt_ns.store(0, std::memory_order_relaxed);
+      client.smoothed_rtt_ns.store(0, std::memory_order_relaxed);
+      if (client.ping.interval_ms) {
+        client.ping_timer.req = req;
+        client.pong_timer.req = req;
+        lws_sul_schedule(lws_get_context(wsi), 0, &client.ping_timer.sul, ping_timer_expired,
+                         client.ping.interval_ms * LWS_US_PER_MS);
+      }
       client.callback->on_connected();
       client.disconnecte_callback_invoked = false;
       break;
 
     case LWS_CALLBACK_CLIENT_WRITEABLE: {
-      auto msg = client.sending_buffer.read();
+      if (client.ping_due) {
+        client.ping_due = false;
+        // the send time travels as payload so a stale pong can't be mistaken for the current one
+        unsigned char ping[LWS_PRE + sizeof(uint64_t)];
+        auto sent = now_ns();
+        memcpy(ping + LWS_PRE, &sent, sizeof(sent));
+        if (lws_write(wsi, ping + LWS_PRE, sizeof(sent), LWS_WRITE_PING) < (int)sizeof(sent)) {
+          req->wsi = nullptr;
+          return -1;
+        }
+        client.ping_sent_ns = sent;
+        client.pong_pending = true;
+        if (client.ping.timeout_ms) {
+          lws_sul_schedule(lws_get_context(wsi), 0, &client.pong_timer.sul, pong_timer_expired,
+                           client.ping.timeout_ms * LWS_US_PER_MS);
+        }
+        // one write per writeable event, queued messages follow on the next one
+        lws_callback_on_writable(wsi);
+        break;
+      }
+
+      uint8_t tag = 0;
+      auto msg = client.sending_buffer.read(&tag);
       if (msg.first && msg.second) {
-        size_t n = lws_write(wsi, (unsigned char*)msg.first + LWS_PRE, msg.second - LWS_PRE, LWS_WRITE_TEXT);
-        if (n < len) {
+        auto payload_len = msg.second - LWS_PRE;
+        auto n = lws_write(wsi, (unsigned char*)msg.first + LWS_PRE, payload_len, to_write_protocol(tag));
+        if (n < (int)payload_len) {
           req->wsi = nullptr;
           return -1;
         }
         lws_callback_on_writable(wsi);
+      } else if (client.write_drained()) {
+        lws_callback_on_writable(wsi);
       }
       break;
     }
 
     case LWS_CALLBACK_CLIENT_RECEIVE: {
       auto remaining = lws_remaining_packet_payload(wsi);
-      client.callback->on_data((const char*)in, len, remaining);
+      if (!client.reassemble) {
+        client.callback->on_data((const char*)in, len, remaining);
+        break;
+      }
+
+      const char* data = nullptr;
+      size_t size = 0;
+      auto last = lws_is_final_fragment(wsi) && !remaining;
+      switch (client.assembler.add((const char*)in, len, last, data, size)) {
+        case message_assembler::result::complete:
+          client.callback->on_data(data, size, 0);
+          break;
+
+        case message_assembler::result::too_large: {
+          lwsl_user("%s:%d message exceeds %zu bytes\n", req->cci.host, req->cci.port, client.assembler.max_size());
+          static const char err[] = "message too large";
+          client.callback->on_error(err, sizeof(err) - 1);
+          lws_close_reason(wsi, LWS_CLOSE_STATUS_MESSAGE_TOO_LARGE, nullptr, 0);
+          req->wsi = nullptr;
+          return -1;
+        }
+
+        default:
+          break;
+      }
+      break;
+    }
+
+    case LWS_CALLBACK_CLIENT_RECEIVE_PONG: {
+      uint64_t sent = 0;
+      if (!client.pong_pending || len != sizeof(sent)) {
+        break;
+      }
+      memcpy(&sent, in, sizeof(sent));
+      if (sent != client.ping_sent_ns) {
+        break;
+      }
+
+      client.pong_pending = false;
+      lws_sul_schedule(lws_get_context(wsi), 0, &client.pong_timer.sul, pong_timer_expired, LWS_SET_TIMER_USEC_CANCEL);
+      auto rtt = now_ns() - sent;
+      auto srtt = client.smoothed_rtt_ns.load(std::memory_order_relaxed);
+      client.last_rtt_ns.store(rtt, std::memory_order_relaxed);
+      client.smoothed_rtt_ns.store(srtt ? srtt - srtt / 8 + rtt / 8 : rtt, std::memory_order_relaxed);
       break;
     }
 
@@ -217,10 +475,12 @@ int ws_callback(struct lws *wsi, enum lws_callback_reasons reason, void *user, v
 
     case LWS_CALLBACK_WSI_DESTROY:
       req->wsi = nullptr;
+      client.cancel_ping(lws_get_context(wsi));
       if (!client.disconnecte_callback_invoked) {
         client.callback->on_disconnected();
         client.disconnecte_callback_invoked = true;
       }
+      req->service->connection_lost(req);
       break;
 
     case LWS_CALLBACK_EVENT_WAIT_CANCELLED:
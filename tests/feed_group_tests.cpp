@@ -0,0 +1,111 @@
+/***
+ *  MIT License
+ *
+ *  Copyright (c) 2021 SlickTech <support@slicktech.org>
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ */
+
+
+
+#include "catch.hpp"
+#include <slicksocket/feed_group.h>
+
+using namespace slick::net;
+
+TEST_CASE("sequence_window drops duplicates", "[feed_group]") {
+  sequence_window window;
+  REQUIRE(window.accept(1));
+  REQUIRE(window.accept(2));
+  REQUIRE_FALSE(window.accept(2));
+  REQUIRE_FALSE(window.accept(1));
+  REQUIRE(window.head() == 2);
+}
+
+TEST_CASE("sequence_window always accepts unsequenced messages", "[feed_group]") {
+  sequence_window window;
+  REQUIRE(window.accept(0));
+  REQUIRE(window.accept(0));
+  REQUIRE(window.head() == 0);
+
+  REQUIRE(window.accept(5));
+  REQUIRE(window.accept(0));
+  REQUIRE(window.head() == 5);
+}
+
+TEST_CASE("sequence_window fills gaps within 64 of the head", "[feed_group]") {
+  sequence_window window;
+  REQUIRE(window.accept(100));
+
+  // 63 behind is the oldest slot of the window
+  REQUIRE(window.accept(37));
+  REQUIRE_FALSE(window.accept(37));
+  // 64 behind fell out of it
+  REQUIRE_FALSE(window.accept(36));
+
+  REQUIRE(window.accept(99));
+  REQUIRE_FALSE(window.accept(99));
+  REQUIRE(window.head() == 100);
+}
+
+TEST_CASE("sequence_window forgets everything on a jump of 64 or more", "[feed_group]") {
+  sequence_window window;
+  for (uint64_t seq = 1; seq <= 10; ++seq) {
+    REQUIRE(window.accept(seq));
+  }
+
+  SECTION("jump of exactly 64") {
+    REQUIRE(window.accept(74));
+    // 10 is now 64 behind
+    REQUIRE_FALSE(window.accept(10));
+    // the window shifted out every earlier bit, 11..73 are all new
+    for (uint64_t seq = 11; seq < 74; ++seq) {
+      REQUIRE(window.accept(seq));
+    }
+    REQUIRE_FALSE(window.accept(74));
+  }
+
+  SECTION("jump of more than 64") {
+    REQUIRE(window.accept(1000));
+    REQUIRE(window.accept(999));
+    REQUIRE(window.accept(1000 - 63));
+    REQUIRE_FALSE(window.accept(1000 - 64));
+    REQUIRE_FALSE(window.accept(10));
+    REQUIRE_FALSE(window.accept(1000));
+  }
+
+  SECTION("jump of 63 keeps the oldest bit") {
+    REQUIRE(window.accept(73));
+    REQUIRE_FALSE(window.accept(10));
+    REQUIRE(window.accept(11));
+  }
+}
+
+TEST_CASE("sequence_window reset accepts a restarted sequence", "[feed_group]") {
+  sequence_window window;
+  REQUIRE(window.accept(500));
+  REQUIRE_FALSE(window.accept(1));
+
+  window.reset();
+  REQUIRE(window.head() == 0);
+  REQUIRE(window.accept(1));
+  REQUIRE(window.accept(2));
+  REQUIRE_FALSE(window.accept(1));
+  REQUIRE(window.accept(500));
+}
@@ -0,0 +1,125 @@
+/***
+ *  MIT License
+ *
+ *  Copyright (c) 2021 SlickTech <support@slicktech.org>
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ */
+
+
+
+#include "catch.hpp"
+#include "message_assembler.h"
+#include <string>
+
+using namespace slick::net;
+
+namespace {
+
+using result = message_assembler::result;
+
+struct delivered {
+  const char* data = nullptr;
+  size_t size = 0;
+
+  std::string str() const { return std::string(data, size); }
+};
+
+result add(message_assembler& assembler, const std::string& fragment, bool last, delivered& msg) {
+  return assembler.add(fragment.data(), fragment.size(), last, msg.data, msg.size);
+}
+
+}
+
+TEST_CASE("message_assembler passes single fragment messages through", "[reassemble]") {
+  message_assembler assembler;
+  std::string whole = "hello";
+  delivered msg;
+  REQUIRE(add(assembler, whole, true, msg) == result::complete);
+  // no copy, points to the fragment
+  REQUIRE(msg.data == whole.data());
+  REQUIRE(msg.size == whole.size());
+}
+
+TEST_CASE("message_assembler joins continuation fragments", "[reassemble]") {
+  message_assembler assembler;
+  delivered msg;
+  REQUIRE(add(assembler, "{\"a\":", false, msg) == result::partial);
+  REQUIRE(add(assembler, "1,\"b\"", false, msg) == result::partial);
+  REQUIRE(add(assembler, ":2}", true, msg) == result::complete);
+  REQUIRE(msg.str() == "{\"a\":1,\"b\":2}");
+
+  // the next message starts from scratch
+  REQUIRE(add(assembler, "x", false, msg) == result::partial);
+  REQUIRE(add(assembler, "y", true, msg) == result::complete);
+  REQUIRE(msg.str() == "xy");
+
+  // and a single fragment one after a joined one is still passed through
+  std::string whole = "z";
+  REQUIRE(add(assembler, whole, true, msg) == result::complete);
+  REQUIRE(msg.data == whole.data());
+}
+
+TEST_CASE("message_assembler clear drops a partial message", "[reassemble]") {
+  message_assembler assembler;
+  delivered msg;
+  REQUIRE(add(assembler, "stale", false, msg) == result::partial);
+  assembler.clear();
+  REQUIRE(add(assembler, "fresh", false, msg) == result::partial);
+  REQUIRE(add(assembler, "!", true, msg) == result::complete);
+  REQUIRE(msg.str() == "fresh!");
+}
+
+TEST_CASE("message_assembler enforces the max message size", "[reassemble]") {
+  message_assembler assembler;
+  assembler.set_max_size(8);
+  delivered msg;
+
+  SECTION("a message of exactly the limit is delivered") {
+    REQUIRE(add(assembler, "1234", false, msg) == result::partial);
+    REQUIRE(add(assembler, "5678", true, msg) == result::complete);
+    REQUIRE(msg.str() == "12345678");
+  }
+
+  SECTION("a single fragment over the limit is rejected") {
+    REQUIRE(add(assembler, "123456789", true, msg) == result::too_large);
+    std::string next = "ok";
+    REQUIRE(add(assembler, next, true, msg) == result::complete);
+    REQUIRE(msg.str() == "ok");
+  }
+
+  SECTION("the rest of a message over the limit is dropped") {
+    REQUIRE(add(assembler, "12345", false, msg) == result::partial);
+    REQUIRE(add(assembler, "6789", false, msg) == result::too_large);
+    REQUIRE(add(assembler, "abc", false, msg) == result::dropped);
+    REQUIRE(add(assembler, "def", true, msg) == result::dropped);
+
+    REQUIRE(add(assembler, "next", false, msg) == result::partial);
+    REQUIRE(add(assembler, "!", true, msg) == result::complete);
+    REQUIRE(msg.str() == "next!");
+  }
+
+  SECTION("0 is unlimited") {
+    assembler.set_max_size(0);
+    std::string large(1 << 20, 'x');
+    REQUIRE(add(assembler, large, false, msg) == result::partial);
+    REQUIRE(add(assembler, large, true, msg) == result::complete);
+    REQUIRE(msg.size == 2 * large.size());
+  }
+}
@@ -0,0 +1,77 @@
+/***
+ *  MIT License
+ *
+ *  Copyright (c) 2021 SlickTech <support@slicktech.org>
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ */
+
+
+
+#include "catch.hpp"
+#include <slicksocket/service_options.h>
+
+using namespace slick::net;
+
+TEST_CASE("reconnect delay doubles up to the cap", "[reconnect]") {
+  reconnect_options options;
+  options.initial_delay_ms = 100;
+  options.max_delay_ms = 3000;
+  options.jitter_percent = 0;
+
+  const uint64_t expected[] = {100, 200, 400, 800, 1600, 3000, 3000};
+  for (uint32_t attempts = 0; attempts < 7; ++attempts) {
+    REQUIRE(options.delay_ms(attempts, 12345) == expected[attempts]);
+  }
+  // no overflow however many attempts failed
+  REQUIRE(options.delay_ms(1000, 0) == 3000);
+  REQUIRE(options.delay_ms(UINT32_MAX, 0) == 3000);
+}
+
+TEST_CASE("reconnect delay never exceeds a cap below the initial delay", "[reconnect]") {
+  reconnect_options options;
+  options.initial_delay_ms = 5000;
+  options.max_delay_ms = 1000;
+  options.jitter_percent = 0;
+  REQUIRE(options.delay_ms(0, 0) == 1000);
+  REQUIRE(options.delay_ms(3, 0) == 1000);
+}
+
+TEST_CASE("reconnect delay jitter spreads around the backoff", "[reconnect]") {
+  reconnect_options options;
+  options.initial_delay_ms = 1000;
+  options.max_delay_ms = 30000;
+  options.jitter_percent = 20;
+
+  // 1000 +/- 200, random picks the point within the 401 possible values
+  REQUIRE(options.delay_ms(0, 0) == 800);
+  REQUIRE(options.delay_ms(0, 200) == 1000);
+  REQUIRE(options.delay_ms(0, 400) == 1200);
+  REQUIRE(options.delay_ms(0, 401) == 800);
+
+  // the spread applies to the capped delay
+  REQUIRE(options.delay_ms(10, 0) == 24000);
+  REQUIRE(options.delay_ms(10, 12000) == 36000);
+
+  SECTION("jitter above 100 percent is clamped") {
+    options.jitter_percent = 250;
+    REQUIRE(options.delay_ms(0, 0) == 0);
+    REQUIRE(options.delay_ms(0, 2000) == 2000);
+  }
+}
@@ -0,0 +1,291 @@
+/***
+ *  MIT License
+ *
+ *  Copyright (c) 2021 SlickTech <support@slicktech.org>
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ */
+
+
+#include "catch.hpp"
+#include "ring_buffer.h"
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace slick::net;
+
+namespace {
+
+send_buffer_options with_policy(overflow_policy policy) {
+  send_buffer_options options;
+  options.overflow = policy;
+  return options;
+}
+
+std::string read_string(ring_string_buffer& buffer) {
+  auto msg = buffer.read();
+  return msg.first ? std::string(msg.first, msg.second) : std::string();
+}
+
+TEST_CASE("ring_string_buffer wraps a message larger than half the ring") {
+  ring_string_buffer buffer(8192);
+  buffer.configure(with_policy(overflow_policy::fail));
+
+  std::string first(3994, 'a');
+  REQUIRE(buffer.write(first.data(), first.size()));
+  REQUIRE(read_string(buffer) == first);
+  // releases the message held by the last read
+  REQUIRE(buffer.read().first == nullptr);
+
+  // doesn't fit before the end of the ring, goes to the start behind SKIP padding
+  std::string second(5000, 'b');
+  REQUIRE(buffer.write(second.data(), second.size()));
+  REQUIRE(read_string(buffer) == second);
+  REQUIRE(buffer.read().first == nullptr);
+}
+
+TEST_CASE("ring_string_buffer blocking producer wraps while the reader runs") {
+  ring_string_buffer buffer(8192);
+  buffer.configure(with_policy(overflow_policy::block));
+
+  std::string first(3994, 'a');
+  std::string second(5000, 'b');
+  REQUIRE(buffer.write(first.data(), first.size()));
+
+  std::vector<std::string> received;
+  std::thread reader([&buffer, &received]() {
+    while (received.size() < 2) {
+      auto msg = buffer.read();
+      if (msg.first) {
+        received.emplace_back(msg.first, msg.second);
+      } else {
+        std::this_thread::yield();
+      }
+    }
+  });
+
+  REQUIRE(buffer.write(second.data(), second.size()));
+  reader.join();
+  REQUIRE(received.size() == 2);
+  REQUIRE(received[0] == first);
+  REQUIRE(received[1] == second);
+}
+
+TEST_CASE("ring_string_buffer keeps per producer order with concurrent producers") {
+  constexpr uint32_t kProducers = 4;
+  constexpr uint32_t kMessages = 20000;
+
+  ring_string_buffer buffer(4096);
+  buffer.configure(with_policy(overflow_policy::block));
+
+  std::vector<std::thread> producers;
+  for (uint32_t p = 0; p < kProducers; ++p) {
+    producers.emplace_back([&buffer, p]() {
+      for (uint32_t seq = 0; seq < kMessages; ++seq) {
+        // variable sizes so messages wrap at different offsets,
+        // some commits are shorter than reserved, some are discarded
+        size_t max_len = 8 + (seq * 7 + p) % 120;
+        ring_string_buffer::reservation r;
+        char* buf = nullptr;
+        while (!(buf = buffer.reserve(r, max_len))) {
+          std::this_thread::yield();
+        }
+        if (seq % 11 == 10) {
+          buffer.commit(r, 0);
+          continue;
+        }
+        size_t len = seq % 3 ? max_len : std::max<size_t>(8, max_len - 1 - seq % 7);
+        memcpy(buf, &p, sizeof(p));
+        memcpy(buf + sizeof(p), &seq, sizeof(seq));
+        memset(buf + 8, (int)(seq & 0xff), len - 8);
+        buffer.commit(r, len);
+      }
+    });
+  }
+
+  size_t expected = 0;
+  for (uint32_t seq = 0; seq < kMessages; ++seq) {
+    expected += seq % 11 != 10;
+  }
+  expected *= kProducers;
+
+  std::vector<int64_t> last(kProducers, -1);
+  size_t received = 0;
+  bool intact = true;
+  while (received < expected && intact) {
+    auto msg = buffer.read();
+    if (!msg.first) {
+      std::this_thread::yield();
+      continue;
+    }
+    uint32_t p, seq;
+    memcpy(&p, msg.first, sizeof(p));
+    memcpy(&seq, msg.first + sizeof(p), sizeof(seq));
+    intact = p < kProducers && (int64_t)seq > last[p] && seq % 11 != 10;
+    for (size_t i = 8; intact && i < msg.second; ++i) {
+      intact = (uint8_t)msg.first[i] == (uint8_t)(seq & 0xff);
+    }
+    if (intact) {
+      last[p] = seq;
+      ++received;
+    }
+  }
+
+  for (auto& t : producers) {
+    t.join();
+  }
+  REQUIRE(intact);
+  REQUIRE(received == expected);
+  REQUIRE(buffer.read().first == nullptr);
+}
+
+TEST_CASE("ring_string_buffer skips discarded and shortened reservations") {
+  ring_string_buffer buffer(256);
+  ring_string_buffer::reservation r;
+
+  auto buf = buffer.reserve(r, 32);
+  REQUIRE(buf);
+  buffer.commit(r, 0);
+
+  // gap too small for a header, left as PAD bytes
+  buf = buffer.reserve(r, 32);
+  memcpy(buf, "0123456789", 10);
+  buffer.commit(r, 29);
+
+  // gap large enough for an INVALID entry
+  buf = buffer.reserve(r, 32);
+  memcpy(buf, "abc", 3);
+  buffer.commit(r, 3);
+
+  REQUIRE(buffer.write("last", 4, 7));
+
+  auto msg = buffer.read();
+  REQUIRE(msg.second == 29);
+  REQUIRE(std::string(msg.first, 10) == "0123456789");
+  REQUIRE(read_string(buffer) == "abc");
+  uint8_t tag = 0;
+  msg = buffer.read(&tag);
+  REQUIRE(std::string(msg.first, msg.second) == "last");
+  REQUIRE(tag == 7);
+  REQUIRE(buffer.read().first == nullptr);
+}
+
+TEST_CASE("ring_string_buffer read_into gathers whole messages") {
+  ring_string_buffer buffer(1024);
+  REQUIRE(buffer.write("aaaa", 4));
+  REQUIRE(buffer.write("bbbbbb", 6));
+  REQUIRE(buffer.write("cc", 2));
+
+  char dest[16];
+  // only the first two fit
+  REQUIRE(buffer.read_into(dest, 10) == 10);
+  REQUIRE(std::string(dest, 10) == "aaaabbbbbb");
+  // next message larger than the capacity
+  REQUIRE(buffer.read_into(dest, 1) == 0);
+  REQUIRE(buffer.read_into(dest, sizeof(dest)) == 2);
+  REQUIRE(std::string(dest, 2) == "cc");
+  REQUIRE(buffer.read_into(dest, sizeof(dest)) == 0);
+}
+
+TEST_CASE("ring_string_buffer spills oversized messages in order") {
+  ring_string_buffer buffer(256);
+  std::string large(1000, 'x');
+  large[999] = 'y';
+
+  REQUIRE(buffer.write("before", 6));
+  REQUIRE(buffer.write(large.data(), large.size()));
+  REQUIRE(buffer.write("after", 5));
+
+  char dest[64];
+  // read_into stops at the spilled message
+  REQUIRE(buffer.read_into(dest, sizeof(dest)) == 6);
+  REQUIRE(buffer.read_into(dest, sizeof(dest)) == 0);
+  REQUIRE(read_string(buffer) == large);
+  REQUIRE(read_string(buffer) == "after");
+  REQUIRE(buffer.read().first == nullptr);
+}
+
+// numbered message of len bytes, 32 bytes in the ring with its header when len is 26
+std::string numbered(uint32_t seq, size_t len) {
+  std::string s(len, 'a' + seq % 26);
+  memcpy(&s[0], &seq, sizeof(seq));
+  return s;
+}
+
+uint32_t number_of(const std::pair<const char*, size_t>& msg) {
+  uint32_t seq;
+  memcpy(&seq, msg.first, sizeof(seq));
+  return seq;
+}
+
+TEST_CASE("ring_string_buffer drop_oldest drops only what the new message needs") {
+  ring_string_buffer buffer(256);
+  buffer.configure(with_policy(overflow_policy::drop_oldest));
+
+  for (uint32_t seq = 0; seq < 8; ++seq) {
+    REQUIRE(buffer.write(numbered(seq, 26).data(), 26));
+  }
+  // 64 bytes, the two oldest make room
+  REQUIRE(buffer.write(numbered(8, 58).data(), 58));
+
+  for (uint32_t seq = 2; seq <= 8; ++seq) {
+    REQUIRE(number_of(buffer.read()) == seq);
+  }
+  REQUIRE_FALSE(buffer.read().first);
+}
+
+TEST_CASE("ring_string_buffer drop_oldest keeps the message being read") {
+  ring_string_buffer buffer(256);
+  buffer.configure(with_policy(overflow_policy::drop_oldest));
+
+  for (uint32_t seq = 0; seq < 8; ++seq) {
+    REQUIRE(buffer.write(numbered(seq, 26).data(), 26));
+  }
+  auto msg = buffer.read();
+  REQUIRE(number_of(msg) == 0);
+
+  // needs 64 bytes: message 1 is dropped, the held message 0 can't be
+  // so the writer waits for the next read instead of dropping the rest
+  std::atomic_bool started{false};
+  std::thread writer([&buffer, &started]() {
+    started.store(true, std::memory_order_release);
+    buffer.write(numbered(8, 58).data(), 58);
+  });
+  while (!started.load(std::memory_order_acquire)) {
+    std::this_thread::yield();
+  }
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  REQUIRE(std::string(msg.first, msg.second) == numbered(0, 26));
+
+  std::vector<uint32_t> received;
+  while (received.empty() || received.back() != 8) {
+    msg = buffer.read();
+    if (msg.first) {
+      received.push_back(number_of(msg));
+    } else {
+      std::this_thread::yield();
+    }
+  }
+  writer.join();
+  REQUIRE(received == std::vector<uint32_t>{2, 3, 4, 5, 6, 7, 8});
+  REQUIRE_FALSE(buffer.read().first);
+}
+}